@@ -4,8 +4,29 @@
  */
 
 #include "stest.h"
+#include <errno.h>
+#include <limits.h>
 #include <setjmp.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#ifdef STEST_POSIX
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+#endif
+#ifdef STEST_IMPACT
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
 
 #ifdef STEST_INTERNAL_TESTS
 static int stest_last_passed = 0;
@@ -19,6 +40,12 @@ static int stest_last_passed = 0;
 #define STEST_RED "\e[0;31m"
 #define STEST_COLOR_RESET "\e[0m"
 
+#define STEST_IMPACT_STEM_SIZE 256
+#define STEST_FUNCTION_NAME_SIZE 256
+#define STEST_MAX_TAGS 64
+#define STEST_MAX_TAG_PROGRAM 256
+#define STEST_MAX_TAG_EXPRESSIONS 16
+
 typedef enum {
   STEST_DISPLAY_TESTS,
   STEST_RUN_TESTS,
@@ -26,6 +53,64 @@ typedef enum {
   STEST_DO_ABORT
 } stest_action_t;
 
+typedef struct {
+  char **keys;
+  size_t size;
+  size_t count;
+} stest_test_set_t;
+
+typedef struct {
+  char name[STEST_IMPACT_STEM_SIZE];
+  int known;
+} stest_impact_stem_t;
+
+typedef struct {
+  char *source;
+  const char *text;
+  size_t len;
+  int exclude;
+  int glob;
+} stest_pattern_t;
+
+typedef struct {
+  stest_pattern_t *patterns;
+  size_t count;
+  size_t includes;
+} stest_filter_t;
+
+typedef enum {
+  STEST_TAG_PUSH,
+  STEST_TAG_NOT,
+  STEST_TAG_AND,
+  STEST_TAG_OR
+} stest_tag_op_t;
+
+typedef struct {
+  unsigned char op;
+  unsigned char tag;
+} stest_tag_instr_t;
+
+typedef struct {
+  unsigned int line;
+  char function[STEST_FUNCTION_NAME_SIZE];
+  char reason[STEST_PRINT_BUFFER_SIZE];
+} stest_failure_t;
+
+typedef struct {
+  int passed;
+  int failed;
+  stest_failure_t failure;
+} stest_isolated_result_t;
+
+typedef struct {
+  long peak_rss_kb;
+  long minor_faults;
+  long major_faults;
+  long voluntary_switches;
+  long involuntary_switches;
+  long cpu_ms;
+} stest_resources_t;
+
 typedef struct {
   int argc;
   char **argv;
@@ -41,13 +126,35 @@ static int stest_verbose = 0;
 static int vs_mode = 0;
 static int stest_machine_readable = 0;
 static int stest_color_output = 0;
+static int stest_report_resources = 0;
+static int stest_isolate = 0;
+static unsigned long stest_limit_memory = 0;
+static unsigned long stest_limit_cpu = 0;
+static unsigned int stest_fuzz_jobs = 0;
+static const char *stest_stream_path;
+static stest_failure_t stest_last_failure;
 static const char *stest_current_fixture;
 static const char *stest_current_fixture_path;
 static char stest_magic_marker[20];
 static int stest_fixture_tests_run = 0;
 static int stest_fixture_tests_failed = 0;
-static const char *stest_fixture_filter;
-static const char *stest_test_filter;
+static stest_filter_t stest_fixture_filters;
+static stest_filter_t stest_test_filters;
+static int stest_option_error = 0;
+static char *stest_tag_names[STEST_MAX_TAGS];
+static int stest_tag_count = 0;
+static stest_tag_instr_t stest_tag_program[STEST_MAX_TAG_PROGRAM];
+static size_t stest_tag_program_len = 0;
+static const char *stest_tag_expressions[STEST_MAX_TAG_EXPRESSIONS];
+static int stest_tag_expression_count = 0;
+static unsigned long long stest_fixture_tags = 0;
+static const char *stest_current_test_tags;
+static const char *stest_impact_record_path;
+static const char *stest_impact_map_path;
+static const char *stest_changed_files_path;
+static stest_test_set_t stest_impact_skipped;
+static stest_impact_stem_t *stest_changed_stems;
+static size_t stest_changed_count = 0;
 
 static jmp_buf env;
 static int skip_failed_test;
@@ -69,6 +176,7 @@ int stest_parse_commandline_option_with_value(stest_testrunner_t *runner,
                                               stest_void_string setter);
 void stest_interpret_commandline(stest_testrunner_t *runner);
 void stest_testrunner_create(stest_testrunner_t *runner, int argc, char **argv);
+static void stest_async_run_pending(void);
 
 void (*stest_simple_test_result)(int passed, const char *reason,
                                  const char *function, unsigned int line) =
@@ -127,6 +235,25 @@ static void stest_add_color(char *outstr, const char *instr,
   }
 }
 
+static long long stest_now_ns(void) {
+#ifdef STEST_POSIX
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#else
+  return (long long)clock() * (1000000000LL / CLOCKS_PER_SEC);
+#endif
+}
+
+static void stest_remember_failure(const char *reason, const char *function,
+                                   unsigned int line) {
+  stest_last_failure.line = line;
+  snprintf(stest_last_failure.function, sizeof(stest_last_failure.function),
+           "%s", function);
+  snprintf(stest_last_failure.reason, sizeof(stest_last_failure.reason), "%s",
+           reason);
+}
+
 static void stest_log_failure(const char *reason, const char *function,
                               unsigned int line) {
   char failed[STEST_PRINT_BUFFER_SIZE];
@@ -163,6 +290,7 @@ void stest_simple_test_result_log(int passed, const char *reason,
     else {
       stest_log_failure(reason, function, line);
     }
+    stest_remember_failure(reason, function, line);
     stests_failed++;
 
     printf("Test has been finished with failure.\r\n");
@@ -280,6 +408,205 @@ void stest_assert_string_not_contains(const char *expected, const char *actual,
   stest_simple_test_result(strstr(actual, expected) == 0, s, function, line);
 }
 
+/*
+Resources
+*/
+
+#ifdef STEST_POSIX
+static struct rusage stest_usage_start;
+
+static long stest_usage_cpu_ms(const struct rusage *usage) {
+  return (long)(usage->ru_utime.tv_sec + usage->ru_stime.tv_sec) * 1000L +
+         (long)(usage->ru_utime.tv_usec + usage->ru_stime.tv_usec) / 1000L;
+}
+
+static long stest_usage_maxrss_kb(const struct rusage *usage) {
+#ifdef __APPLE__
+  return usage->ru_maxrss / 1024;
+#else
+  return usage->ru_maxrss;
+#endif
+}
+
+/* Only Linux can reset the peak RSS, elsewhere the peak is the one of the
+ * whole process unless the test runs isolated */
+static void stest_reset_peak_rss(void) {
+#ifdef __linux__
+  FILE *file = fopen("/proc/self/clear_refs", "w");
+  if(file == NULL)
+    return;
+  fputs("5", file);
+  fclose(file);
+#endif
+}
+
+static long stest_peak_rss_kb(void) {
+  struct rusage usage;
+#ifdef __linux__
+  FILE *file = fopen("/proc/self/status", "r");
+  if(file != NULL) {
+    char line[256];
+    long peak = -1;
+    while(fgets(line, sizeof(line), file)) {
+      if(sscanf(line, "VmHWM: %ld kB", &peak) == 1)
+        break;
+    }
+    fclose(file);
+    if(peak >= 0)
+      return peak;
+  }
+#endif
+  getrusage(RUSAGE_SELF, &usage);
+  return stest_usage_maxrss_kb(&usage);
+}
+
+static void stest_resources_from_usage(stest_resources_t *resources,
+                                       const struct rusage *end,
+                                       const struct rusage *start) {
+  resources->peak_rss_kb = stest_usage_maxrss_kb(end);
+  resources->minor_faults = end->ru_minflt - start->ru_minflt;
+  resources->major_faults = end->ru_majflt - start->ru_majflt;
+  resources->voluntary_switches = end->ru_nvcsw - start->ru_nvcsw;
+  resources->involuntary_switches = end->ru_nivcsw - start->ru_nivcsw;
+  resources->cpu_ms = stest_usage_cpu_ms(end) - stest_usage_cpu_ms(start);
+}
+
+/* Resetting and reading the peak RSS and the usage takes microseconds, which
+ * dominates short tests, so it is only done when -r, -i or a limit is on */
+static int stest_resources_wanted(void) {
+  return (stest_report_resources && !stest_machine_readable) || stest_isolate;
+}
+
+static void stest_resources_begin(void) {
+  if(!stest_resources_wanted()) {
+    memset(&stest_usage_start, 0, sizeof(stest_usage_start));
+    return;
+  }
+  stest_reset_peak_rss();
+  getrusage(RUSAGE_SELF, &stest_usage_start);
+}
+
+static void stest_resources_measure(stest_resources_t *resources) {
+  struct rusage usage;
+  if(!stest_resources_wanted()) {
+    memset(resources, 0, sizeof(stest_resources_t));
+    return;
+  }
+  getrusage(RUSAGE_SELF, &usage);
+  stest_resources_from_usage(resources, &usage, &stest_usage_start);
+  resources->peak_rss_kb = stest_peak_rss_kb();
+}
+
+void stest_assert_peak_rss_below(unsigned long bytes, const char *function,
+                                 unsigned int line) {
+  char s[STEST_PRINT_BUFFER_SIZE];
+  unsigned long peak = (unsigned long)stest_peak_rss_kb() * 1024UL;
+  sprintf(s, "Expected peak RSS below %lu bytes but was %lu", bytes, peak);
+  stest_simple_test_result(peak < bytes, s, function, line);
+}
+
+void stest_assert_cpu_time_below(unsigned long ms, const char *function,
+                                 unsigned int line) {
+  char s[STEST_PRINT_BUFFER_SIZE];
+  struct rusage usage;
+  long cpu_ms;
+  getrusage(RUSAGE_SELF, &usage);
+  cpu_ms = stest_usage_cpu_ms(&usage) - stest_usage_cpu_ms(&stest_usage_start);
+  sprintf(s, "Expected CPU time below %lums but was %ldms", ms, cpu_ms);
+  stest_simple_test_result(cpu_ms < (long)ms, s, function, line);
+}
+#else
+static void stest_resources_begin(void) {}
+
+static void stest_resources_measure(stest_resources_t *resources) {
+  memset(resources, 0, sizeof(stest_resources_t));
+}
+#endif
+
+/* Machine readable lines are all results, so usage is only reported to
+ * people */
+static void stest_resources_report(const char *test,
+                                   const stest_resources_t *resources) {
+  if(!stest_report_resources || stest_machine_readable)
+    return;
+  printf("%-30s Peak RSS %ldKB, faults %ld/%ld, context switches %ld/%ld, "
+         "CPU %ldms\r\n",
+         test, resources->peak_rss_kb, resources->minor_faults,
+         resources->major_faults, resources->voluntary_switches,
+         resources->involuntary_switches, resources->cpu_ms);
+}
+
+/* Returns 0 unless value is a whole number with an optional K, M or G
+ * suffix that fits in an unsigned long */
+static int stest_parse_size(const char *value, unsigned long *size) {
+  char *end;
+  int shift = 0;
+  if(*value < '0' || *value > '9')
+    return 0;
+  errno = 0;
+  *size = strtoul(value, &end, 10);
+  if(errno == ERANGE)
+    return 0;
+  switch(*end) {
+  case 'G':
+  case 'g':
+    shift += 10;
+    /* fall through */
+  case 'M':
+  case 'm':
+    shift += 10;
+    /* fall through */
+  case 'K':
+  case 'k':
+    shift += 10;
+    end++;
+    break;
+  default:
+    break;
+  }
+  if(*size > (ULONG_MAX >> shift))
+    return 0;
+  *size <<= shift;
+  return *end == '\0';
+}
+
+void limit_memory(const char *bytes) {
+  if(!stest_parse_size(bytes, &stest_limit_memory)) {
+    printf("Error: The --limit-memory option expects a size in bytes, "
+           "got %s\r\n",
+           bytes);
+    stest_option_error = 1;
+    return;
+  }
+  stest_isolate = 1;
+}
+
+void limit_cpu(const char *seconds) {
+  char *end;
+  errno = 0;
+  stest_limit_cpu = strtoul(seconds, &end, 10);
+  if(*seconds < '0' || *seconds > '9' || *end != '\0' || errno == ERANGE) {
+    printf("Error: The --limit-cpu option expects a number of seconds, "
+           "got %s\r\n",
+           seconds);
+    stest_option_error = 1;
+    return;
+  }
+  stest_isolate = 1;
+}
+
+void fuzz_jobs(const char *jobs) {
+  char *end;
+  errno = 0;
+  stest_fuzz_jobs = strtoul(jobs, &end, 10);
+  if(*jobs < '0' || *jobs > '9' || *end != '\0' || errno == ERANGE) {
+    printf("Error: The --fuzz-jobs option expects a number of workers, "
+           "got %s\r\n",
+           jobs);
+    stest_option_error = 1;
+  }
+}
+
 void stest_header_printer(const char *s, int s_len, int length, char f) {
   int d = (length - (s_len + 2)) / 2;
   int i;
@@ -299,6 +626,7 @@ void stest_header_printer(const char *s, int s_len, int length, char f) {
 void stest_test_fixture_start(const char *filepath) {
   stest_current_fixture_path = filepath;
   stest_current_fixture = test_file_name(filepath);
+  stest_fixture_tags = 0;
 
   if(!stest_should_run_fixture(stest_current_fixture)) {
     return;
@@ -320,6 +648,7 @@ void stest_test_fixture_start(const char *filepath) {
 
 void stest_test_fixture_end(void) {
   char s[STEST_PRINT_BUFFER_SIZE];
+  stest_async_run_pending();
   sprintf(s, "%d run %d failed", stests_run - stest_fixture_tests_run,
           stests_failed - stest_fixture_tests_failed);
   stest_header_printer(s, strlen(s), stest_screen_width, ' ');
@@ -328,155 +657,2012 @@ void stest_test_fixture_end(void) {
   printf("\r\n");
 }
 
-void fixture_filter(const char *filter) { stest_fixture_filter = filter; }
+/*
+Filters
+*/
+
+static int stest_filter_has(const stest_filter_t *filter, const char *pattern) {
+  size_t i;
+  for(i = 0; i < filter->count; i++) {
+    if(!strcmp(filter->patterns[i].source, pattern))
+      return 1;
+  }
+  return 0;
+}
 
-void test_filter(const char *filter) { stest_test_filter = filter; }
+/* Each value holds comma separated patterns. A leading '!' excludes the
+ * names matching the rest of the pattern, '*' and '?' make it a glob that
+ * has to match the whole name, anything else matches as a prefix. */
+static void stest_filter_add(stest_filter_t *filter, const char *value) {
+  const char *start = value;
+  while(*start) {
+    size_t len = strcspn(start, ",");
+    stest_pattern_t *grown, *pattern;
+    char *source = malloc(len + 1);
+    if(source == NULL)
+      return;
+    memcpy(source, start, len);
+    source[len] = '\0';
+    start += len + (start[len] == ',');
+    if(len == 0 || stest_filter_has(filter, source)) {
+      free(source);
+      continue;
+    }
+    grown = realloc(filter->patterns,
+                    (filter->count + 1) * sizeof(stest_pattern_t));
+    if(grown == NULL) {
+      free(source);
+      return;
+    }
+    filter->patterns = grown;
+    pattern = &filter->patterns[filter->count++];
+    pattern->source = source;
+    pattern->exclude = source[0] == '!';
+    pattern->text = source + pattern->exclude;
+    pattern->len = strlen(pattern->text);
+    pattern->glob = strpbrk(pattern->text, "*?") != NULL;
+    if(!pattern->exclude)
+      filter->includes++;
+  }
+}
 
-void set_magic_marker(const char *marker) {
-  if(marker == NULL)
-    return;
-  strcpy(stest_magic_marker, marker);
+static int stest_glob_matches(const char *glob, const char *name) {
+  const char *star = NULL, *resume = NULL;
+  while(*name) {
+    if(*glob == '*') {
+      star = glob++;
+      resume = name;
+    }
+    else if(*glob == '?' || *glob == *name) {
+      glob++;
+      name++;
+    }
+    else if(star) {
+      glob = star + 1;
+      name = ++resume;
+    }
+    else {
+      return 0;
+    }
+  }
+  while(*glob == '*')
+    glob++;
+  return *glob == '\0';
 }
 
-int stest_should_run_test(const char *test) {
-  int run = 1;
+static int stest_pattern_matches(const stest_pattern_t *pattern,
+                                 const char *name) {
+  if(pattern->glob)
+    return stest_glob_matches(pattern->text, name);
+  return strncmp(pattern->text, name, pattern->len) == 0;
+}
 
-  if(stest_fixture_filter) {
-    if(strncmp(stest_fixture_filter, stest_current_fixture,
-               strlen(stest_fixture_filter)) != 0)
-      run = 0;
+static int stest_filter_matches(const stest_filter_t *filter,
+                                const char *name) {
+  int included = filter->includes == 0;
+  size_t i;
+  for(i = 0; i < filter->count; i++) {
+    if(!stest_pattern_matches(&filter->patterns[i], name))
+      continue;
+    if(filter->patterns[i].exclude)
+      return 0;
+    included = 1;
   }
+  return included;
+}
 
-  if(stest_test_filter && test != NULL) {
-    if(strncmp(stest_test_filter, test, strlen(stest_test_filter)) != 0)
-      run = 0;
-  }
+void fixture_filter(const char *filter) {
+  stest_filter_add(&stest_fixture_filters, filter);
+}
 
-  return run;
+void test_filter(const char *filter) {
+  stest_filter_add(&stest_test_filters, filter);
 }
 
-int stest_should_run_fixture(const char *fixture) {
-  int run = 1;
+/*
+Tags
+*/
+
+static int stest_is_tag_char(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_' || c == '-' || c == '.' ||
+         c == ':';
+}
 
-  if(stest_fixture_filter) {
-    if(strncmp(stest_fixture_filter, fixture, strlen(stest_fixture_filter)) !=
-       0)
-      run = 0;
+static int stest_tag_find(const char *name, size_t len) {
+  int i;
+  for(i = 0; i < stest_tag_count; i++) {
+    if(strlen(stest_tag_names[i]) == len &&
+       !strncmp(stest_tag_names[i], name, len))
+      return i;
   }
+  return -1;
+}
 
-  return run;
+static int stest_tag_intern(const char *name, size_t len) {
+  int tag = stest_tag_find(name, len);
+  if(tag >= 0 || stest_tag_count == STEST_MAX_TAGS)
+    return tag;
+  stest_tag_names[stest_tag_count] = malloc(len + 1);
+  if(stest_tag_names[stest_tag_count] == NULL)
+    return -1;
+  memcpy(stest_tag_names[stest_tag_count], name, len);
+  stest_tag_names[stest_tag_count][len] = '\0';
+  return stest_tag_count++;
 }
 
-void stest_test(const char *test, void (*test_function)(void)) {
-  if(!stest_should_run_test(test)) {
-    return;
+/* Only the tags used by the expressions get a bit, others cannot change the
+ * result */
+static unsigned long long stest_tag_mask(const char *tags) {
+  unsigned long long mask = 0;
+  while(tags && *tags) {
+    size_t len = 0;
+    int tag;
+    while(tags[len] && stest_is_tag_char(tags[len]))
+      len++;
+    if(len == 0) {
+      tags++;
+      continue;
+    }
+    tag = stest_tag_find(tags, len);
+    if(tag >= 0)
+      mask |= 1ULL << tag;
+    tags += len;
   }
+  return mask;
+}
 
-  if(stest_is_display_only()) {
-    printf("%s\n", test);
-    return;
-  }
+static int stest_tag_emit(unsigned char op, unsigned char tag) {
+  if(stest_tag_program_len == STEST_MAX_TAG_PROGRAM)
+    return 0;
+  stest_tag_program[stest_tag_program_len].op = op;
+  stest_tag_program[stest_tag_program_len].tag = tag;
+  stest_tag_program_len++;
+  return 1;
+}
 
-  stest_suite_setup();
-  stest_setup();
+static void stest_tag_skip_spaces(const char **expr) {
+  while(**expr == ' ')
+    (*expr)++;
+}
 
-  skip_failed_test = setjmp(env);
-  if(!skip_failed_test)
-    test_function();
+static int stest_tag_parse_or(const char **expr);
 
-  stest_teardown();
-  stest_suite_teardown();
-  stests_run++;
+static int stest_tag_parse_unary(const char **expr) {
+  size_t len = 0;
+  int tag;
+  stest_tag_skip_spaces(expr);
+  if(**expr == '!') {
+    (*expr)++;
+    return stest_tag_parse_unary(expr) && stest_tag_emit(STEST_TAG_NOT, 0);
+  }
+  if(**expr == '(') {
+    (*expr)++;
+    if(!stest_tag_parse_or(expr))
+      return 0;
+    stest_tag_skip_spaces(expr);
+    if(**expr != ')')
+      return 0;
+    (*expr)++;
+    return 1;
+  }
+  while(stest_is_tag_char((*expr)[len]))
+    len++;
+  if(len == 0 || (tag = stest_tag_intern(*expr, len)) < 0)
+    return 0;
+  *expr += len;
+  return stest_tag_emit(STEST_TAG_PUSH, (unsigned char)tag);
 }
 
-int run_tests(stest_void_void tests) {
-  char s[40];
-  tests();
+static int stest_tag_parse_and(const char **expr) {
+  if(!stest_tag_parse_unary(expr))
+    return 0;
+  for(;;) {
+    stest_tag_skip_spaces(expr);
+    if(**expr != '&')
+      return 1;
+    (*expr)++;
+    if(!stest_tag_parse_unary(expr) || !stest_tag_emit(STEST_TAG_AND, 0))
+      return 0;
+  }
+}
 
-  if(stest_is_display_only() || stest_machine_readable)
-    return STEST_RET_OK;
-  if(stests_failed > 0) {
-    if(stest_machine_readable) {
-      stest_header_printer("Failed", sizeof("Failed") - 1, stest_screen_width,
-                           ' ');
-    }
-    else {
-      char failed[30];
-      stest_add_color(failed, "failed", STEST_RED);
-      stest_header_printer(failed, sizeof("Failed") - 1, stest_screen_width,
-                           ' ');
-    }
+static int stest_tag_parse_or(const char **expr) {
+  if(!stest_tag_parse_and(expr))
+    return 0;
+  for(;;) {
+    stest_tag_skip_spaces(expr);
+    if(**expr != '|')
+      return 1;
+    (*expr)++;
+    if(!stest_tag_parse_and(expr) || !stest_tag_emit(STEST_TAG_OR, 0))
+      return 0;
   }
-  else {
-    if(stest_machine_readable) {
-      stest_header_printer("ALL TESTS PASSED", sizeof("ALL TESTS PASSED") - 1,
-                           stest_screen_width, ' ');
-    }
-    else {
-      char passed[30];
-      stest_add_color(passed, "ALL TESTS PASSED", STEST_GREEN);
-      stest_header_printer(passed, sizeof("ALL TESTS PASSED") - 1,
-                           stest_screen_width, ' ');
-    }
+}
+
+/* Compiles the expression into postfix instructions, several expressions
+ * have to match all of them */
+static int stest_tag_compile(const char *expression) {
+  const char *expr = expression;
+  size_t start = stest_tag_program_len;
+  int i, valid = 0;
+  for(i = 0; i < stest_tag_expression_count; i++) {
+    if(!strcmp(stest_tag_expressions[i], expression))
+      return 1;
   }
-  if(stests_run == 1) {
-    strcpy(s, "1 test run");
+  if(stest_tag_expression_count < STEST_MAX_TAG_EXPRESSIONS &&
+     stest_tag_parse_or(&expr)) {
+    stest_tag_skip_spaces(&expr);
+    valid = *expr == '\0' && (start == 0 || stest_tag_emit(STEST_TAG_AND, 0));
   }
-  else {
-    sprintf(s, "%d tests run", stests_run);
+  if(!valid) {
+    stest_tag_program_len = start;
+    return 0;
   }
-  stest_header_printer(s, strlen(s), stest_screen_width, ' ');
-  printf("\r\n");
-  stest_header_printer("", sizeof("") - 1, stest_screen_width, '=');
+  stest_tag_expressions[stest_tag_expression_count++] = expression;
+  return 1;
+}
 
-  return STEST_RET_FAILED_COUNT(stests_failed);
+void tag_filter(const char *expression) {
+  if(!stest_tag_compile(expression)) {
+    printf("Error: invalid tag expression %s\r\n", expression);
+    stest_option_error = 1;
+  }
 }
 
-void stest_show_help(void) {
-  printf("Usage: [-t <testname>] [-f <fixturename>] [-d] [-h | --help] [-v] "
-         "[-m] [-k <marker>]\r\n");
-  printf("Flags:\r\n");
-  printf("\thelp:\twill display this help\r\n");
-  printf("\t-t:\twill only run tests that match <testname>\r\n");
-  printf("\t-f:\twill only run fixtures that match <fixturename>\r\n");
-  printf("\t-d:\twill just display test names and fixtures without\r\n");
-  printf("\t\trunning the test\r\n");
-  printf("\t-v:\twill print a more verbose version of the test run\r\n");
-  printf("\t-m:\twill print a machine readable format of the test run, ie :- "
-         "\r\n");
-  printf("\t   \t<textfixture>,<testname>,<linenumber>,<testresult><EOL>\r\n");
-  printf("\t-k:\twill prepend <marker> before machine readable output \r\n");
-  printf("\t   \t<marker> cannot start with a '-'\r\n");
-  printf("\t-c:\twill color output with ANSI escape codes\r\n");
+static int stest_tags_match(unsigned long long mask) {
+  unsigned char stack[STEST_MAX_TAG_PROGRAM];
+  size_t i, depth = 0;
+  for(i = 0; i < stest_tag_program_len; i++) {
+    switch(stest_tag_program[i].op) {
+    case STEST_TAG_PUSH:
+      stack[depth++] = (mask >> stest_tag_program[i].tag) & 1;
+      break;
+    case STEST_TAG_NOT:
+      stack[depth - 1] = !stack[depth - 1];
+      break;
+    case STEST_TAG_AND:
+      depth--;
+      stack[depth - 1] = stack[depth - 1] && stack[depth];
+      break;
+    case STEST_TAG_OR:
+      depth--;
+      stack[depth - 1] = stack[depth - 1] || stack[depth];
+      break;
+    }
+  }
+  return depth == 0 || stack[0];
 }
 
-int stest_commandline_has_value_after(stest_testrunner_t *runner, int arg) {
-  if(!((arg + 1) < runner->argc))
-    return 0;
-  if(runner->argv[arg + 1][0] == '-')
-    return 0;
-  return 1;
+void stest_tagged_test_fixture_start(const char *filepath, const char *tags) {
+  stest_test_fixture_start(filepath);
+  stest_fixture_tags = stest_tag_mask(tags);
 }
 
-int stest_parse_commandline_option_with_value(stest_testrunner_t *runner,
-                                              int arg, const char *option,
-                                              stest_void_string setter) {
-  if(!strcmp(runner->argv[arg], option)) {
-    if(!stest_commandline_has_value_after(runner, arg)) {
-      printf("Error: The %s option expects to be followed by a value\r\n",
-             option);
-      runner->action = STEST_DO_ABORT;
-      return 0;
-    }
-    setter(runner->argv[arg + 1]);
-    return 1;
+void stest_tagged_test(const char *test, void (*test_function)(void),
+                       const char *tags) {
+  stest_current_test_tags = tags;
+  stest_test(test, test_function);
+  stest_current_test_tags = NULL;
+}
+
+#ifdef STEST_POSIX
+void stest_tagged_async_test(const char *test, stest_async_start start,
+                             unsigned int timeout_ms, const char *tags) {
+  stest_current_test_tags = tags;
+  stest_async_test(test, start, timeout_ms);
+  stest_current_test_tags = NULL;
+}
+
+void stest_tagged_fuzz_corpus(const char *test, stest_fuzz_target target,
+                              const char *directory, const char *tags) {
+  stest_current_test_tags = tags;
+  stest_fuzz_corpus(test, target, directory);
+  stest_current_test_tags = NULL;
+}
+#endif
+
+void set_magic_marker(const char *marker) {
+  if(marker == NULL)
+    return;
+  strcpy(stest_magic_marker, marker);
+}
+
+/*
+Test impact analysis
+*/
+
+#define STEST_HASH_OFFSET 2166136261UL
+#define STEST_HASH_PRIME 16777619UL
+
+static unsigned long stest_hash_string(const char *s, unsigned long hash) {
+  for(; *s; s++)
+    hash = (hash ^ (unsigned char)*s) * STEST_HASH_PRIME;
+  return hash;
+}
+
+static unsigned long stest_hash_test(const char *fixture, const char *test) {
+  unsigned long hash = stest_hash_string(fixture, STEST_HASH_OFFSET);
+  return stest_hash_string(test, stest_hash_string("\t", hash));
+}
+
+static int stest_test_key_equals(const char *key, const char *fixture,
+                                 const char *test) {
+  size_t len = strlen(fixture);
+  return !strncmp(key, fixture, len) && key[len] == '\t' &&
+         !strcmp(key + len + 1, test);
+}
+
+static int stest_test_set_contains(const stest_test_set_t *set,
+                                   const char *fixture, const char *test) {
+  size_t i;
+  if(set->size == 0)
+    return 0;
+  for(i = stest_hash_test(fixture, test) & (set->size - 1); set->keys[i];
+      i = (i + 1) & (set->size - 1)) {
+    if(stest_test_key_equals(set->keys[i], fixture, test))
+      return 1;
   }
   return 0;
 }
 
-void stest_interpret_commandline(stest_testrunner_t *runner) {
-  int arg;
-  for(arg = 1; (arg < runner->argc) && (runner->action != STEST_DO_ABORT);
+static void stest_test_set_insert(stest_test_set_t *set, char *key) {
+  size_t i;
+  for(i = stest_hash_string(key, STEST_HASH_OFFSET) & (set->size - 1);
+      set->keys[i]; i = (i + 1) & (set->size - 1))
+    ;
+  set->keys[i] = key;
+  set->count++;
+}
+
+static int stest_test_set_grow(stest_test_set_t *set) {
+  stest_test_set_t grown;
+  size_t i;
+  grown.size = set->size ? set->size * 2 : 64;
+  grown.count = 0;
+  grown.keys = calloc(grown.size, sizeof(char *));
+  if(grown.keys == NULL)
+    return 0;
+  for(i = 0; i < set->size; i++) {
+    if(set->keys[i])
+      stest_test_set_insert(&grown, set->keys[i]);
+  }
+  free(set->keys);
+  *set = grown;
+  return 1;
+}
+
+static void stest_test_set_add(stest_test_set_t *set, const char *fixture,
+                               const char *test) {
+  char *key;
+  if(stest_test_set_contains(set, fixture, test))
+    return;
+  if((set->count + 1) * 2 > set->size && !stest_test_set_grow(set))
+    return;
+  key = malloc(strlen(fixture) + strlen(test) + 2);
+  if(key == NULL)
+    return;
+  sprintf(key, "%s\t%s", fixture, test);
+  stest_test_set_insert(set, key);
+}
+
+static void stest_test_set_clear(stest_test_set_t *set) {
+  size_t i;
+  for(i = 0; i < set->size; i++)
+    free(set->keys[i]);
+  free(set->keys);
+  set->keys = NULL;
+  set->size = 0;
+  set->count = 0;
+}
+
+static char *stest_read_line(FILE *file, char **buf, size_t *cap) {
+  size_t len = 0;
+  if(*buf == NULL) {
+    *cap = 256;
+    *buf = malloc(*cap);
+    if(*buf == NULL)
+      return NULL;
+  }
+  while(fgets(*buf + len, (int)(*cap - len), file)) {
+    char *grown;
+    len += strlen(*buf + len);
+    if(len > 0 && (*buf)[len - 1] == '\n') {
+      (*buf)[--len] = '\0';
+      if(len > 0 && (*buf)[len - 1] == '\r')
+        (*buf)[--len] = '\0';
+      return *buf;
+    }
+    if(len + 1 < *cap)
+      return *buf;
+    grown = realloc(*buf, *cap * 2);
+    if(grown == NULL)
+      return NULL;
+    *buf = grown;
+    *cap *= 2;
+  }
+  return len > 0 ? *buf : NULL;
+}
+
+/* Sources are matched by file name without extensions, so src/parser.c
+ * matches both parser.c.gcda (CMake) and parser.gcda (plain make) */
+static void stest_file_stem(const char *path, char *stem) {
+  const char *name = test_file_name(path);
+  size_t len = strcspn(name, ".");
+  if(len >= STEST_IMPACT_STEM_SIZE)
+    len = STEST_IMPACT_STEM_SIZE - 1;
+  memcpy(stem, name, len);
+  stem[len] = '\0';
+}
+
+/* gcc names the counters of a single compile-and-link command after the
+ * output, so `gcc --coverage parser.c -o t` records t-parser */
+static int stest_stem_matches(const char *recorded, const char *changed) {
+  size_t len = strlen(recorded), changed_len = strlen(changed);
+  if(!strcmp(recorded, changed))
+    return 1;
+  return len > changed_len && recorded[len - changed_len - 1] == '-' &&
+         !strcmp(recorded + len - changed_len, changed);
+}
+
+static int stest_impact_read_changed(void) {
+  FILE *file = fopen(stest_changed_files_path, "r");
+  char *line = NULL;
+  size_t cap = 0;
+  if(file == NULL)
+    return 0;
+  while(stest_read_line(file, &line, &cap)) {
+    stest_impact_stem_t *grown;
+    if(*line == '\0')
+      continue;
+    grown = realloc(stest_changed_stems,
+                    (stest_changed_count + 1) * sizeof(stest_impact_stem_t));
+    if(grown == NULL)
+      break;
+    stest_changed_stems = grown;
+    stest_file_stem(line, stest_changed_stems[stest_changed_count].name);
+    stest_changed_stems[stest_changed_count].known = 0;
+    stest_changed_count++;
+  }
+  free(line);
+  fclose(file);
+  return 1;
+}
+
+static void stest_impact_select(void) {
+  FILE *file;
+  char *line = NULL;
+  size_t cap = 0, i;
+
+  if(stest_impact_map_path == NULL || stest_changed_files_path == NULL)
+    return;
+  if(!stest_impact_read_changed()) {
+    printf("Warning: cannot read %s, running all tests\r\n",
+           stest_changed_files_path);
+    return;
+  }
+  file = fopen(stest_impact_map_path, "r");
+  if(file == NULL) {
+    printf("Warning: cannot read %s, running all tests\r\n",
+           stest_impact_map_path);
+    return;
+  }
+
+  while(stest_read_line(file, &line, &cap)) {
+    char *fixture = strtok(line, "\t");
+    char *test = strtok(NULL, "\t");
+    char *source;
+    int recorded = 0, affected = 0;
+    if(fixture == NULL || test == NULL)
+      continue;
+    while((source = strtok(NULL, "\t")) != NULL) {
+      char stem[STEST_IMPACT_STEM_SIZE];
+      stest_file_stem(source, stem);
+      recorded = 1;
+      for(i = 0; i < stest_changed_count; i++) {
+        if(stest_stem_matches(stem, stest_changed_stems[i].name)) {
+          stest_changed_stems[i].known = 1;
+          affected = 1;
+        }
+      }
+    }
+    /* tests without recorded coverage always run */
+    if(recorded && !affected)
+      stest_test_set_add(&stest_impact_skipped, fixture, test);
+  }
+  free(line);
+  fclose(file);
+
+  /* a changed file that no test covers (a header, a build script...) could
+   * affect anything */
+  for(i = 0; i < stest_changed_count; i++) {
+    if(!stest_changed_stems[i].known) {
+      stest_test_set_clear(&stest_impact_skipped);
+      break;
+    }
+  }
+  free(stest_changed_stems);
+  stest_changed_stems = NULL;
+  stest_changed_count = 0;
+}
+
+#ifdef STEST_IMPACT
+extern void __gcov_dump(void);
+extern void __gcov_reset(void);
+
+#define STEST_GCDA_MAGIC 0x67636461u
+#define STEST_GCDA_TAG_FUNCTION 0x01000000u
+#define STEST_GCDA_TAG_COUNTERS_END 0x02000000u
+
+static char stest_impact_dir[STEST_PRINT_BUFFER_SIZE];
+static FILE *stest_impact_file;
+static char *stest_impact_saved_prefix;
+
+static int stest_gcda_walk(const unsigned char *data, size_t size, size_t pos,
+                           size_t unit, int *executed) {
+  while(pos + 8 <= size) {
+    unsigned int tag, len;
+    size_t i;
+    memcpy(&tag, data + pos, 4);
+    memcpy(&len, data + pos + 4, 4);
+    pos += 8;
+    if(tag == 0)
+      return 0;
+    /* newer gcc writes all-zero counters as a negative length and no data */
+    if((int)len < 0) {
+      if(unit != 1)
+        return 0;
+      continue;
+    }
+    if(len * unit > size - pos)
+      return 0;
+    if(tag > STEST_GCDA_TAG_FUNCTION && tag < STEST_GCDA_TAG_COUNTERS_END) {
+      for(i = 0; i < len * unit; i++) {
+        if(data[pos + i])
+          *executed = 1;
+      }
+    }
+    pos += len * unit;
+  }
+  return pos == size;
+}
+
+/* The header and record length units changed between gcc versions, so try
+ * each layout and keep the one that describes the whole file */
+static int stest_gcda_executed(const unsigned char *data, size_t size) {
+  static const size_t headers[] = {16, 12};
+  static const size_t units[] = {1, 4};
+  unsigned int magic;
+  size_t h, u;
+  if(size < 12)
+    return 1;
+  memcpy(&magic, data, 4);
+  if(magic != STEST_GCDA_MAGIC)
+    return 1;
+  for(h = 0; h < 2; h++) {
+    for(u = 0; u < 2; u++) {
+      int executed = 0;
+      if(stest_gcda_walk(data, size, headers[h], units[u], &executed))
+        return executed;
+    }
+  }
+  return 1;
+}
+
+static int stest_gcda_file_executed(const char *path) {
+  FILE *file = fopen(path, "rb");
+  unsigned char *data;
+  long size;
+  int executed = 1;
+  if(file == NULL)
+    return 1;
+  if(fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) > 0 &&
+     fseek(file, 0, SEEK_SET) == 0 && (data = malloc(size)) != NULL) {
+    if(fread(data, 1, size, file) == (size_t)size)
+      executed = stest_gcda_executed(data, size);
+    free(data);
+  }
+  fclose(file);
+  return executed;
+}
+
+/* Writes every executed object found under dir to the map and removes the
+ * dumped files, so the next test starts from an empty directory */
+static void stest_impact_collect(const char *dir) {
+  DIR *d = opendir(dir);
+  struct dirent *entry;
+  if(d == NULL)
+    return;
+  while((entry = readdir(d)) != NULL) {
+    char path[STEST_PRINT_BUFFER_SIZE];
+    struct stat st;
+    size_t len;
+    if(!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+      continue;
+    snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+    if(lstat(path, &st) != 0)
+      continue;
+    if(S_ISDIR(st.st_mode)) {
+      stest_impact_collect(path);
+      rmdir(path);
+      continue;
+    }
+    len = strlen(path);
+    if(len > 5 && !strcmp(path + len - 5, ".gcda") &&
+       stest_gcda_file_executed(path)) {
+      fprintf(stest_impact_file, "\t%.*s",
+              (int)(len - 5 - strlen(stest_impact_dir)),
+              path + strlen(stest_impact_dir));
+    }
+    unlink(path);
+  }
+  closedir(d);
+}
+
+static void stest_impact_start_recording(void) {
+  const char *tmp = getenv("TMPDIR");
+  const char *prefix = getenv("GCOV_PREFIX");
+  snprintf(stest_impact_dir, sizeof(stest_impact_dir), "%s/stest-XXXXXX",
+           tmp ? tmp : "/tmp");
+  if(mkdtemp(stest_impact_dir) == NULL) {
+    perror(stest_impact_dir);
+    return;
+  }
+  stest_impact_file = fopen(stest_impact_record_path, "w");
+  if(stest_impact_file == NULL) {
+    perror(stest_impact_record_path);
+    rmdir(stest_impact_dir);
+    return;
+  }
+  stest_impact_saved_prefix = prefix ? strdup(prefix) : NULL;
+}
+
+static void stest_impact_stop_recording(void) {
+  if(stest_impact_file == NULL)
+    return;
+  fclose(stest_impact_file);
+  stest_impact_file = NULL;
+  rmdir(stest_impact_dir);
+  if(stest_impact_saved_prefix)
+    setenv("GCOV_PREFIX", stest_impact_saved_prefix, 1);
+  else
+    unsetenv("GCOV_PREFIX");
+  free(stest_impact_saved_prefix);
+  stest_impact_saved_prefix = NULL;
+}
+#endif
+
+static void stest_impact_start(void) {
+  stest_impact_select();
+#ifdef STEST_IMPACT
+  if(stest_impact_record_path && !stest_is_display_only())
+    stest_impact_start_recording();
+#endif
+}
+
+static void stest_impact_stop(void) {
+  stest_test_set_clear(&stest_impact_skipped);
+#ifdef STEST_IMPACT
+  stest_impact_stop_recording();
+#endif
+}
+
+static void stest_impact_child_exit(void) {
+#ifdef STEST_IMPACT
+  if(stest_impact_file == NULL)
+    return;
+  setenv("GCOV_PREFIX", stest_impact_dir, 1);
+  __gcov_dump();
+#endif
+}
+
+static void stest_impact_test_begin(void) {
+#ifdef STEST_IMPACT
+  if(stest_impact_file)
+    __gcov_reset();
+#endif
+}
+
+static void stest_impact_test_end(const char *test) {
+#ifdef STEST_IMPACT
+  if(stest_impact_file == NULL)
+    return;
+  setenv("GCOV_PREFIX", stest_impact_dir, 1);
+  __gcov_dump();
+  fprintf(stest_impact_file, "%s\t%s", stest_current_fixture, test);
+  stest_impact_collect(stest_impact_dir);
+  fprintf(stest_impact_file, "\n");
+#else
+  (void)test;
+#endif
+}
+
+void impact_record(const char *path) { stest_impact_record_path = path; }
+
+void impact_map(const char *path) { stest_impact_map_path = path; }
+
+void impact_changed_files(const char *path) {
+  stest_changed_files_path = path;
+}
+
+int stest_should_run_test(const char *test) {
+  int run = 1;
+
+  if(!stest_filter_matches(&stest_fixture_filters, stest_current_fixture))
+    run = 0;
+
+  if(test != NULL && !stest_filter_matches(&stest_test_filters, test))
+    run = 0;
+
+  if(run && test != NULL && stest_tag_program_len > 0 &&
+     !stest_tags_match(stest_fixture_tags |
+                       stest_tag_mask(stest_current_test_tags)))
+    run = 0;
+
+  if(run && test != NULL &&
+     stest_test_set_contains(&stest_impact_skipped, stest_current_fixture, test))
+    run = 0;
+
+  return run;
+}
+
+int stest_should_run_fixture(const char *fixture) {
+  return stest_filter_matches(&stest_fixture_filters, fixture);
+}
+
+/*
+Test Arena
+*/
+
+typedef struct stest_arena_chunk {
+  struct stest_arena_chunk *next;
+  size_t size;
+  size_t used;
+} stest_arena_chunk_t;
+
+typedef struct {
+  stest_arena_chunk_t *chunk;
+  size_t used;
+} stest_arena_mark_t;
+
+#define STEST_ARENA_ALIGN(size)                                                \
+  (((size) + STEST_ARENA_ALIGNMENT - 1) & ~(size_t)(STEST_ARENA_ALIGNMENT - 1))
+#define STEST_ARENA_HEADER_SIZE STEST_ARENA_ALIGN(sizeof(stest_arena_chunk_t))
+/* Larger sizes would wrap around when aligned or when the header is added */
+#define STEST_ARENA_MAX_SIZE                                                   \
+  ((size_t)-1 - STEST_ARENA_ALIGNMENT - STEST_ARENA_HEADER_SIZE)
+
+static stest_arena_chunk_t *stest_arena_chunks = NULL;
+static stest_arena_chunk_t *stest_arena_current = NULL;
+static size_t stest_arena_chunk_bytes = STEST_ARENA_CHUNK_SIZE;
+
+void arena_chunk_size(size_t size) {
+  stest_arena_chunk_bytes = size > 0 ? size : STEST_ARENA_CHUNK_SIZE;
+}
+
+static stest_arena_chunk_t *stest_arena_new_chunk(size_t size) {
+  stest_arena_chunk_t *chunk;
+  if(size < stest_arena_chunk_bytes)
+    size = stest_arena_chunk_bytes;
+  if(size > STEST_ARENA_MAX_SIZE)
+    return NULL;
+  chunk = malloc(STEST_ARENA_HEADER_SIZE + size);
+  if(chunk == NULL)
+    return NULL;
+  chunk->size = size;
+  chunk->used = 0;
+  if(stest_arena_current) {
+    chunk->next = stest_arena_current->next;
+    stest_arena_current->next = chunk;
+  }
+  else {
+    chunk->next = stest_arena_chunks;
+    stest_arena_chunks = chunk;
+  }
+  return chunk;
+}
+
+void *stest_alloc(size_t size) {
+  stest_arena_chunk_t *chunk = stest_arena_current;
+  if(size > STEST_ARENA_MAX_SIZE) {
+    stest_simple_test_result(0, "Could not allocate from the test arena",
+                             "stest_alloc", 0);
+    return NULL;
+  }
+  size = STEST_ARENA_ALIGN(size);
+  if(chunk == NULL)
+    chunk = stest_arena_chunks;
+  /* chunks after the current one were kept from earlier tests */
+  while(chunk && chunk->size - chunk->used < size) {
+    if(chunk->next == NULL || chunk->next->size < size) {
+      chunk = NULL;
+      break;
+    }
+    chunk = chunk->next;
+  }
+  if(chunk == NULL && (chunk = stest_arena_new_chunk(size)) == NULL) {
+    stest_simple_test_result(0, "Could not allocate from the test arena",
+                             "stest_alloc", 0);
+    return NULL;
+  }
+  stest_arena_current = chunk;
+  chunk->used += size;
+  return (char *)chunk + STEST_ARENA_HEADER_SIZE + chunk->used - size;
+}
+
+void *stest_calloc(size_t count, size_t size) {
+  void *ptr;
+  if(size != 0 && count > (size_t)-1 / size) {
+    stest_simple_test_result(0, "Could not allocate from the test arena",
+                             "stest_calloc", 0);
+    return NULL;
+  }
+  ptr = stest_alloc(count * size);
+  if(ptr)
+    memset(ptr, 0, count * size);
+  return ptr;
+}
+
+char *stest_strdup(const char *s) {
+  size_t len = strlen(s) + 1;
+  char *copy = stest_alloc(len);
+  if(copy)
+    memcpy(copy, s, len);
+  return copy;
+}
+
+/* Keeps the regular chunks from link on for the next test and returns the
+ * ones that were made larger for a single big allocation */
+static void stest_arena_reset_from(stest_arena_chunk_t **link) {
+  while(*link) {
+    stest_arena_chunk_t *chunk = *link;
+    if(chunk->size > stest_arena_chunk_bytes) {
+      *link = chunk->next;
+      free(chunk);
+      continue;
+    }
+    chunk->used = 0;
+    link = &chunk->next;
+  }
+}
+
+static void stest_arena_reset(void) {
+  stest_arena_reset_from(&stest_arena_chunks);
+  stest_arena_current = NULL;
+}
+
+static stest_arena_mark_t stest_arena_mark(void) {
+  stest_arena_mark_t mark;
+  mark.chunk = stest_arena_current;
+  mark.used = mark.chunk ? mark.chunk->used : 0;
+  return mark;
+}
+
+/* Reclaims what was allocated since the mark. Chunks after the current one
+ * were unused when the mark was taken, so they can all be reset. */
+static void stest_arena_rewind(stest_arena_mark_t mark) {
+  if(mark.chunk == NULL) {
+    stest_arena_reset();
+    return;
+  }
+  mark.chunk->used = mark.used;
+  stest_arena_reset_from(&mark.chunk->next);
+  stest_arena_current = mark.chunk;
+}
+
+static void stest_arena_release(void) {
+  while(stest_arena_chunks) {
+    stest_arena_chunk_t *chunk = stest_arena_chunks;
+    stest_arena_chunks = chunk->next;
+    free(chunk);
+  }
+  stest_arena_current = NULL;
+}
+
+/*
+Result Stream
+*/
+
+static FILE *stest_stream_file = NULL;
+
+void result_stream(const char *path) { stest_stream_path = path; }
+
+static void stest_put_u16(unsigned char *buf, unsigned int value) {
+  buf[0] = value & 0xff;
+  buf[1] = (value >> 8) & 0xff;
+}
+
+static void stest_put_u32(unsigned char *buf, unsigned long value) {
+  stest_put_u16(buf, value & 0xffff);
+  stest_put_u16(buf + 2, (value >> 16) & 0xffff);
+}
+
+static void stest_put_u64(unsigned char *buf, unsigned long long value) {
+  stest_put_u32(buf, (unsigned long)(value & 0xffffffffUL));
+  stest_put_u32(buf + 4, (unsigned long)(value >> 32));
+}
+
+static size_t stest_stream_field_len(const char *s) {
+  size_t len = s ? strlen(s) : 0;
+  return len > 0xffff ? 0xffff : len;
+}
+
+static void stest_stream_open(void) {
+  unsigned char header[STEST_STREAM_HEADER_SIZE];
+  if(stest_stream_path == NULL || stest_is_display_only())
+    return;
+  stest_stream_file = fopen(stest_stream_path, "ab");
+  if(stest_stream_file == NULL) {
+    perror(stest_stream_path);
+    return;
+  }
+  if(fseek(stest_stream_file, 0, SEEK_END) == 0 &&
+     ftell(stest_stream_file) == 0) {
+    memcpy(header, STEST_STREAM_MAGIC, 4);
+    stest_put_u32(header + 4, STEST_STREAM_VERSION);
+    fwrite(header, 1, sizeof(header), stest_stream_file);
+  }
+}
+
+static void stest_stream_close(void) {
+  if(stest_stream_file == NULL)
+    return;
+  fclose(stest_stream_file);
+  stest_stream_file = NULL;
+}
+
+/* See STEST_STREAM_MAGIC in stest.h for the record layout */
+static void stest_stream_write(const char *test, int failed,
+                               long long duration_ns) {
+  unsigned char record[STEST_STREAM_RECORD_SIZE];
+  const char *fields[5];
+  size_t lens[5], total = STEST_STREAM_RECORD_SIZE - 4;
+  int i;
+
+  if(stest_stream_file == NULL)
+    return;
+  fields[0] = stest_current_fixture;
+  fields[1] = test;
+  fields[2] = stest_current_fixture_path;
+  fields[3] = failed ? stest_last_failure.function : NULL;
+  fields[4] = failed ? stest_last_failure.reason : NULL;
+  for(i = 0; i < 5; i++) {
+    lens[i] = stest_stream_field_len(fields[i]);
+    total += lens[i];
+  }
+
+  stest_put_u32(record, total);
+  record[4] = failed ? STEST_STREAM_FAILED : STEST_STREAM_PASSED;
+  record[5] = record[6] = record[7] = 0;
+  stest_put_u64(record + 8, duration_ns > 0 ? duration_ns : 0);
+  stest_put_u32(record + 16, failed ? stest_last_failure.line : 0);
+  for(i = 0; i < 5; i++)
+    stest_put_u16(record + 20 + i * 2, lens[i]);
+  fwrite(record, 1, sizeof(record), stest_stream_file);
+  for(i = 0; i < 5; i++)
+    fwrite(fields[i], 1, lens[i], stest_stream_file);
+}
+
+static void stest_test_in_process(void (*test_function)(void)) {
+  stest_suite_setup();
+  stest_setup();
+
+  skip_failed_test = setjmp(env);
+  if(!skip_failed_test)
+    test_function();
+
+  stest_teardown();
+  stest_suite_teardown();
+  stest_arena_reset();
+}
+
+static void stest_report_test_failure(const char *test, const char *reason) {
+  if(!setjmp(env))
+    stest_simple_test_result(0, reason, test, 0);
+}
+
+#ifdef STEST_POSIX
+static void stest_apply_limits(void) {
+  struct rlimit limit;
+  if(stest_limit_memory) {
+    limit.rlim_cur = limit.rlim_max = stest_limit_memory;
+    setrlimit(RLIMIT_AS, &limit);
+  }
+  if(stest_limit_cpu) {
+    /* SIGXCPU at the soft limit, SIGKILL if the test ignores it */
+    limit.rlim_cur = stest_limit_cpu;
+    limit.rlim_max = stest_limit_cpu + 1;
+    setrlimit(RLIMIT_CPU, &limit);
+  }
+}
+
+static int stest_pipe_transfer(int fd, void *buf, size_t size, int writing) {
+  size_t done = 0;
+  while(done < size) {
+    ssize_t n = writing ? write(fd, (char *)buf + done, size - done)
+                        : read(fd, (char *)buf + done, size - done);
+    if(n < 0 && errno == EINTR)
+      continue;
+    if(n <= 0)
+      return 0;
+    done += n;
+  }
+  return 1;
+}
+
+/* Runs the test in a child process, which gets its own resource accounting
+ * and limits, and can crash without taking the test run down with it */
+static void stest_test_isolated(const char *test,
+                                void (*test_function)(void),
+                                stest_resources_t *resources) {
+  static stest_isolated_result_t result;
+  struct rusage usage, start;
+  int fds[2], status = 0, completed;
+  pid_t pid;
+
+  fflush(stdout);
+  if(pipe(fds) != 0 || (pid = fork()) < 0) {
+    perror(test);
+    stest_test_in_process(test_function);
+    stest_resources_measure(resources);
+    return;
+  }
+
+  if(pid == 0) {
+    int passed = stests_passed, failed = stests_failed;
+    close(fds[0]);
+    /* the child's usage starts from zero, not from the parent's */
+    stest_resources_begin();
+    stest_apply_limits();
+    stest_test_in_process(test_function);
+    result.passed = stests_passed - passed;
+    result.failed = stests_failed - failed;
+    result.failure = stest_last_failure;
+    if(!stest_pipe_transfer(fds[1], &result, sizeof(result), 1))
+      perror(test);
+    stest_impact_child_exit();
+    fflush(stdout);
+    _exit(0);
+  }
+
+  close(fds[1]);
+  completed = stest_pipe_transfer(fds[0], &result, sizeof(result), 0);
+  close(fds[0]);
+  memset(&usage, 0, sizeof(usage));
+  while(wait4(pid, &status, 0, &usage) < 0 && errno == EINTR)
+    ;
+
+  memset(&start, 0, sizeof(start));
+  stest_resources_from_usage(resources, &usage, &start);
+  if(completed) {
+    stests_passed += result.passed;
+    stests_failed += result.failed;
+    if(result.failed)
+      stest_last_failure = result.failure;
+  }
+
+  if(WIFSIGNALED(status)) {
+    char s[STEST_PRINT_BUFFER_SIZE];
+    sprintf(s, "Test was killed by signal %d (%s)", WTERMSIG(status),
+            strsignal(WTERMSIG(status)));
+    stest_report_test_failure(test, s);
+  }
+  else if(!completed) {
+    stest_report_test_failure(test, "Test exited before it completed");
+  }
+}
+#else
+static void stest_test_isolated(const char *test,
+                                void (*test_function)(void),
+                                stest_resources_t *resources) {
+  stest_test_in_process(test_function);
+  stest_resources_measure(resources);
+}
+#endif
+
+void stest_test(const char *test, void (*test_function)(void)) {
+  stest_resources_t resources;
+  long long started;
+  int failed;
+  if(!stest_should_run_test(test)) {
+    return;
+  }
+
+  if(stest_is_display_only()) {
+    printf("%s\n", test);
+    return;
+  }
+
+  failed = stests_failed;
+  started = stest_now_ns();
+  stest_impact_test_begin();
+  stest_resources_begin();
+  if(stest_isolate) {
+    stest_test_isolated(test, test_function, &resources);
+  }
+  else {
+    stest_test_in_process(test_function);
+    stest_resources_measure(&resources);
+  }
+  stest_impact_test_end(test);
+  stest_resources_report(test, &resources);
+  stest_stream_write(test, stests_failed != failed, stest_now_ns() - started);
+  stests_run++;
+}
+
+#ifdef STEST_POSIX
+/*
+Async Tests
+*/
+
+typedef struct stest_async_watcher {
+  stest_async_t *async;
+  int fd;
+  int events;
+  stest_async_callback callback;
+  void *data;
+  struct stest_async_watcher *next;
+} stest_async_watcher_t;
+
+typedef struct stest_async_timer {
+  long long due_ms;
+  int active;
+  stest_async_callback callback;
+  void *data;
+  struct stest_async_timer *next;
+} stest_async_timer_t;
+
+struct stest_async {
+  const char *test;
+  stest_async_start start;
+  stest_void_void setup;
+  stest_void_void teardown;
+  long long deadline_ms;
+  long long started_ns;
+  int done;
+  int failed;
+  int finished;
+  stest_async_watcher_t *watchers;
+  stest_async_timer_t *timers;
+  struct stest_async *next;
+};
+
+static stest_async_t *stest_async_pending = NULL;
+static stest_async_t **stest_async_pending_tail = &stest_async_pending;
+static int stest_async_unfinished = 0;
+
+static long long stest_now_ms(void) { return stest_now_ns() / 1000000; }
+
+static void stest_async_dispatch(stest_async_watcher_t *watcher, int events);
+
+#ifdef __linux__
+#define STEST_ASYNC_MAX_EVENTS 64
+
+static int stest_async_epoll = -1;
+
+static int stest_async_backend_open(void) {
+  stest_async_epoll = epoll_create1(EPOLL_CLOEXEC);
+  return stest_async_epoll >= 0;
+}
+
+static void stest_async_backend_close(void) {
+  close(stest_async_epoll);
+  stest_async_epoll = -1;
+}
+
+static int stest_async_backend_set(stest_async_watcher_t *watcher, int op) {
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  if(watcher->events & STEST_ASYNC_READ)
+    ev.events |= EPOLLIN;
+  if(watcher->events & STEST_ASYNC_WRITE)
+    ev.events |= EPOLLOUT;
+  ev.data.ptr = watcher;
+  return epoll_ctl(stest_async_epoll, op, watcher->fd, &ev) == 0;
+}
+
+static int stest_async_backend_add(stest_async_watcher_t *watcher) {
+  return stest_async_backend_set(watcher, EPOLL_CTL_ADD);
+}
+
+static int stest_async_backend_modify(stest_async_watcher_t *watcher) {
+  return stest_async_backend_set(watcher, EPOLL_CTL_MOD);
+}
+
+static void stest_async_backend_remove(stest_async_watcher_t *watcher) {
+  epoll_ctl(stest_async_epoll, EPOLL_CTL_DEL, watcher->fd, NULL);
+}
+
+static void stest_async_backend_wait(int timeout_ms) {
+  struct epoll_event events[STEST_ASYNC_MAX_EVENTS];
+  int i, n = epoll_wait(stest_async_epoll, events, STEST_ASYNC_MAX_EVENTS,
+                        timeout_ms);
+  for(i = 0; i < n; i++) {
+    int ready = 0;
+    if(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+      ready |= STEST_ASYNC_READ;
+    if(events[i].events & (EPOLLOUT | EPOLLERR))
+      ready |= STEST_ASYNC_WRITE;
+    stest_async_dispatch(events[i].data.ptr, ready);
+  }
+}
+#else
+/* poll() fallback, the watchers are collected from the pending tests */
+static int stest_async_backend_open(void) { return 1; }
+static void stest_async_backend_close(void) {}
+static int stest_async_backend_add(stest_async_watcher_t *watcher) {
+  return fcntl(watcher->fd, F_GETFD) != -1;
+}
+static int stest_async_backend_modify(stest_async_watcher_t *watcher) {
+  return 1;
+}
+static void stest_async_backend_remove(stest_async_watcher_t *watcher) {}
+
+static void stest_async_backend_wait(int timeout_ms) {
+  struct pollfd *fds = NULL;
+  stest_async_watcher_t **watchers = NULL;
+  stest_async_watcher_t *watcher;
+  stest_async_t *async;
+  size_t count = 0, cap = 0, i;
+
+  for(async = stest_async_pending; async; async = async->next) {
+    for(watcher = async->watchers; watcher; watcher = watcher->next) {
+      if(watcher->fd < 0)
+        continue;
+      if(count == cap) {
+        cap = cap ? cap * 2 : 64;
+        fds = realloc(fds, cap * sizeof(struct pollfd));
+        watchers = realloc(watchers, cap * sizeof(stest_async_watcher_t *));
+        if(fds == NULL || watchers == NULL)
+          goto out;
+      }
+      fds[count].fd = watcher->fd;
+      fds[count].events = 0;
+      fds[count].revents = 0;
+      if(watcher->events & STEST_ASYNC_READ)
+        fds[count].events |= POLLIN;
+      if(watcher->events & STEST_ASYNC_WRITE)
+        fds[count].events |= POLLOUT;
+      watchers[count++] = watcher;
+    }
+  }
+
+  if(poll(fds, count, timeout_ms) > 0) {
+    for(i = 0; i < count; i++) {
+      int ready = 0;
+      if(fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+        ready |= STEST_ASYNC_READ;
+      if(fds[i].revents & (POLLOUT | POLLERR))
+        ready |= STEST_ASYNC_WRITE;
+      if(ready)
+        stest_async_dispatch(watchers[i], ready);
+    }
+  }
+out:
+  free(fds);
+  free(watchers);
+}
+#endif
+
+static void stest_async_finish(stest_async_t *async) {
+  stest_async_watcher_t *watcher;
+  stest_async_timer_t *timer;
+  if(async->finished)
+    return;
+  async->finished = 1;
+  stest_async_unfinished--;
+  /* the watchers and timers stay allocated until the batch is over since
+   * events for them may still be queued in this iteration */
+  for(watcher = async->watchers; watcher; watcher = watcher->next) {
+    if(watcher->fd >= 0)
+      stest_async_backend_remove(watcher);
+    watcher->fd = -1;
+  }
+  for(timer = async->timers; timer; timer = timer->next)
+    timer->active = 0;
+  stest_stream_write(async->test, async->failed,
+                     stest_now_ns() - async->started_ns);
+  stests_run++;
+}
+
+/* Every callback runs under its own setjmp so a failed assert only ends the
+ * async test that made it */
+static void stest_async_call(stest_async_t *async,
+                             stest_async_callback callback, int fd,
+                             void *data) {
+  if(setjmp(env)) {
+    async->failed = 1;
+    stest_async_finish(async);
+    return;
+  }
+  callback(async, fd, data);
+  if(async->done)
+    stest_async_finish(async);
+}
+
+static void stest_async_call_start(stest_async_t *async, int fd, void *data) {
+  (void)fd;
+  (void)data;
+  async->start(async);
+}
+
+static void stest_async_dispatch(stest_async_watcher_t *watcher, int events) {
+  if(watcher->fd < 0 || !(watcher->events & events))
+    return;
+  stest_async_call(watcher->async, watcher->callback, watcher->fd,
+                   watcher->data);
+}
+
+static void stest_async_timeout(stest_async_t *async, int fd, void *data) {
+  (void)fd;
+  (void)data;
+  async->failed = 1;
+  stest_simple_test_result(0, "Async test timed out", async->test, 0);
+  async->done = 1;
+}
+
+static int stest_async_next_timeout(void) {
+  long long next = -1, now = stest_now_ms();
+  stest_async_t *async;
+  stest_async_timer_t *timer;
+  for(async = stest_async_pending; async; async = async->next) {
+    if(async->finished)
+      continue;
+    if(next < 0 || async->deadline_ms < next)
+      next = async->deadline_ms;
+    for(timer = async->timers; timer; timer = timer->next) {
+      if(timer->active && timer->due_ms < next)
+        next = timer->due_ms;
+    }
+  }
+  if(next < 0)
+    return 0;
+  return next > now ? (int)(next - now) : 0;
+}
+
+static void stest_async_fire_timers(void) {
+  long long now = stest_now_ms();
+  stest_async_t *async;
+  stest_async_timer_t *timer;
+  for(async = stest_async_pending; async; async = async->next) {
+    for(timer = async->timers; timer && !async->finished;
+        timer = timer->next) {
+      if(!timer->active || timer->due_ms > now)
+        continue;
+      timer->active = 0;
+      stest_async_call(async, timer->callback, -1, timer->data);
+    }
+    if(!async->finished && async->deadline_ms <= now)
+      stest_async_call(async, stest_async_timeout, -1, NULL);
+  }
+}
+
+static void stest_async_free_pending(void) {
+  while(stest_async_pending) {
+    stest_async_t *async = stest_async_pending;
+    stest_async_pending = async->next;
+    while(async->watchers) {
+      stest_async_watcher_t *watcher = async->watchers;
+      async->watchers = watcher->next;
+      free(watcher);
+    }
+    while(async->timers) {
+      stest_async_timer_t *timer = async->timers;
+      async->timers = timer->next;
+      free(timer);
+    }
+    free(async);
+  }
+  stest_async_pending_tail = &stest_async_pending;
+  stest_async_unfinished = 0;
+}
+
+static int stest_async_seen_before(const stest_async_t *until,
+                                   stest_void_void setup,
+                                   stest_void_void teardown) {
+  const stest_async_t *async;
+  for(async = stest_async_pending; async != until; async = async->next) {
+    if(async->setup == setup && async->teardown == teardown)
+      return 1;
+  }
+  return 0;
+}
+
+/* The tests of a batch run at the same time, so they share one run of each
+ * distinct set-up and tear-down instead of tearing down each other's state */
+static void stest_async_run_pending(void) {
+  stest_async_t *async;
+  if(stest_async_pending == NULL)
+    return;
+  if(!stest_async_backend_open()) {
+    perror("Could not create the async event loop");
+    stest_async_free_pending();
+    return;
+  }
+
+  stest_suite_setup();
+  for(async = stest_async_pending; async; async = async->next) {
+    if(async->setup && !stest_async_seen_before(async, async->setup,
+                                                async->teardown))
+      async->setup();
+  }
+  for(async = stest_async_pending; async; async = async->next) {
+    async->started_ns = stest_now_ns();
+    async->deadline_ms += async->started_ns / 1000000;
+    stest_async_call(async, stest_async_call_start, -1, NULL);
+  }
+
+  while(stest_async_unfinished > 0) {
+    stest_async_backend_wait(stest_async_next_timeout());
+    stest_async_fire_timers();
+  }
+
+  for(async = stest_async_pending; async; async = async->next) {
+    if(async->teardown && !stest_async_seen_before(async, async->setup,
+                                                   async->teardown))
+      async->teardown();
+  }
+  stest_suite_teardown();
+  stest_async_backend_close();
+  stest_async_free_pending();
+  stest_arena_reset();
+}
+
+static void stest_async_queue(const char *test, stest_async_start start,
+                              unsigned int timeout_ms) {
+  stest_async_t *async = calloc(1, sizeof(stest_async_t));
+  if(async == NULL) {
+    perror(test);
+    return;
+  }
+  async->test = test;
+  async->start = start;
+  async->setup = stest_fixture_setup;
+  async->teardown = stest_fixture_teardown;
+  async->deadline_ms = timeout_ms;
+  *stest_async_pending_tail = async;
+  stest_async_pending_tail = &async->next;
+  stest_async_unfinished++;
+}
+
+void stest_async_test(const char *test, stest_async_start start,
+                      unsigned int timeout_ms) {
+  if(!stest_should_run_test(test)) {
+    return;
+  }
+
+  if(stest_is_display_only()) {
+    printf("%s\n", test);
+    return;
+  }
+
+  stest_async_queue(test, start, timeout_ms);
+}
+
+void stest_async_watch(stest_async_t *async, int fd, int events,
+                       stest_async_callback callback, void *data) {
+  stest_async_watcher_t *watcher;
+  for(watcher = async->watchers; watcher; watcher = watcher->next) {
+    if(watcher->fd == fd) {
+      watcher->events = events;
+      watcher->callback = callback;
+      watcher->data = data;
+      stest_simple_test_result(stest_async_backend_modify(watcher),
+                               "Could not watch file descriptor", async->test,
+                               0);
+      return;
+    }
+  }
+
+  watcher = calloc(1, sizeof(stest_async_watcher_t));
+  if(watcher == NULL) {
+    stest_simple_test_result(0, "Could not allocate watcher", async->test, 0);
+    return;
+  }
+  watcher->async = async;
+  watcher->fd = fd;
+  watcher->events = events;
+  watcher->callback = callback;
+  watcher->data = data;
+  watcher->next = async->watchers;
+  async->watchers = watcher;
+  if(!stest_async_backend_add(watcher)) {
+    watcher->fd = -1;
+    stest_simple_test_result(0, "Could not watch file descriptor",
+                             async->test, 0);
+  }
+}
+
+void stest_async_unwatch(stest_async_t *async, int fd) {
+  stest_async_watcher_t *watcher;
+  for(watcher = async->watchers; watcher; watcher = watcher->next) {
+    if(watcher->fd == fd) {
+      stest_async_backend_remove(watcher);
+      watcher->fd = -1;
+    }
+  }
+}
+
+void stest_async_timer(stest_async_t *async, unsigned int ms,
+                       stest_async_callback callback, void *data) {
+  stest_async_timer_t *timer = calloc(1, sizeof(stest_async_timer_t));
+  if(timer == NULL) {
+    stest_simple_test_result(0, "Could not allocate timer", async->test, 0);
+    return;
+  }
+  timer->due_ms = stest_now_ms() + ms;
+  timer->active = 1;
+  timer->callback = callback;
+  timer->data = data;
+  timer->next = async->timers;
+  async->timers = timer;
+}
+
+void stest_async_done(stest_async_t *async) { async->done = 1; }
+#else
+static void stest_async_run_pending(void) {}
+#endif
+
+/*
+Fuzz Targets
+*/
+
+/* Under libFuzzer a failed assert has to crash, that is what it records as a
+ * finding and minimizes */
+static void stest_simple_test_result_fuzz(int passed, const char *reason,
+                                          const char *function,
+                                          unsigned int line) {
+  if(passed)
+    return;
+  stest_log_failure(reason, function, line);
+  fflush(stdout);
+  abort();
+}
+
+int stest_fuzz_one(stest_fuzz_target target, const unsigned char *data,
+                   size_t size) {
+  stest_simple_test_result = stest_simple_test_result_fuzz;
+  target(data, size);
+  stest_arena_reset();
+  return 0;
+}
+
+#ifdef STEST_POSIX
+#define STEST_FUZZ_STARTED 0
+#define STEST_FUZZ_FAILED 1
+#define STEST_FUZZ_FINISHED 2
+
+typedef struct {
+  int type;
+  long input;
+} stest_fuzz_message_t;
+
+typedef struct {
+  pid_t pid;
+  int fd;
+  int finished;
+  long current;
+  size_t next;
+} stest_fuzz_worker_t;
+
+static const char *stest_fuzz_current_test;
+static stest_fuzz_target stest_fuzz_current_target;
+static const char *stest_fuzz_current_directory;
+
+/* Keeps the failure of an input and jumps back to the replay loop */
+static void stest_simple_test_result_replay(int passed, const char *reason,
+                                            const char *function,
+                                            unsigned int line) {
+  if(passed)
+    return;
+  stest_remember_failure(reason, function, line);
+  longjmp(env, 1);
+}
+
+static int stest_fuzz_compare(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* Lists the regular files of the corpus, sorted so that every run replays
+ * the inputs in the same order */
+static int stest_fuzz_list(const char *directory, char ***paths,
+                           size_t *count) {
+  DIR *dir = opendir(directory);
+  struct dirent *entry;
+  size_t capacity = 0;
+  *paths = NULL;
+  *count = 0;
+  if(dir == NULL)
+    return 0;
+  while((entry = readdir(dir)) != NULL) {
+    struct stat st;
+    char *path;
+    if(entry->d_name[0] == '.')
+      continue;
+    path = malloc(strlen(directory) + strlen(entry->d_name) + 2);
+    if(path == NULL)
+      break;
+    sprintf(path, "%s/%s", directory, entry->d_name);
+    if(stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+      free(path);
+      continue;
+    }
+    if(*count == capacity) {
+      char **grown;
+      capacity = capacity ? capacity * 2 : 64;
+      grown = realloc(*paths, capacity * sizeof(char *));
+      if(grown == NULL) {
+        free(path);
+        break;
+      }
+      *paths = grown;
+    }
+    (*paths)[(*count)++] = path;
+  }
+  closedir(dir);
+  if(*count > 1)
+    qsort(*paths, *count, sizeof(char *), stest_fuzz_compare);
+  return 1;
+}
+
+/* Returns 0 and leaves the failure in stest_last_failure when the target
+ * fails on the input. The input is mapped read only, so the target sees the
+ * file without a copy and crashes if it writes to it */
+static int stest_fuzz_run_input(const char *path) {
+  static const unsigned char empty[1];
+  void (*result)(int, const char *, const char *, unsigned int) =
+      stest_simple_test_result;
+  const unsigned char *data = empty;
+  volatile int passed = 1;
+  stest_arena_mark_t mark;
+  struct stat st;
+  int fd = open(path, O_RDONLY);
+
+  if(fd < 0 || fstat(fd, &st) != 0) {
+    stest_remember_failure(strerror(errno), stest_fuzz_current_test, 0);
+    if(fd >= 0)
+      close(fd);
+    return 0;
+  }
+  if(st.st_size > 0) {
+    void *mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(mapped == MAP_FAILED) {
+      stest_remember_failure(strerror(errno), stest_fuzz_current_test, 0);
+      close(fd);
+      return 0;
+    }
+    data = mapped;
+  }
+  close(fd);
+
+  /* inputs get their own arena, what the set-up allocated stays */
+  mark = stest_arena_mark();
+  stest_simple_test_result = stest_simple_test_result_replay;
+  if(setjmp(env))
+    passed = 0;
+  else
+    stest_fuzz_current_target(data, st.st_size);
+  stest_simple_test_result = result;
+  stest_arena_rewind(mark);
+  if(data != empty)
+    munmap((void *)data, st.st_size);
+  return passed;
+}
+
+static void stest_fuzz_report(const char *path,
+                              const stest_failure_t *failure) {
+  char s[STEST_PRINT_BUFFER_SIZE];
+  char function[sizeof(failure->function)];
+  unsigned int line = failure->line;
+  snprintf(s, sizeof(s), "Input %s: ", path);
+  strncat(s, failure->reason, sizeof(s) - strlen(s) - 1);
+  strcpy(function, failure->function);
+  if(!setjmp(env))
+    stest_simple_test_result(0, s, function, line);
+}
+
+static void stest_fuzz_run_inputs(char **paths, size_t count, size_t first,
+                                  size_t step) {
+  size_t i;
+  for(i = first; i < count; i += step) {
+    if(!stest_fuzz_run_input(paths[i]))
+      stest_fuzz_report(paths[i], &stest_last_failure);
+  }
+}
+
+/* Announces each input before running it, so that the parent knows which
+ * one crashed when the worker dies */
+static void stest_fuzz_worker_run(char **paths, size_t count, size_t first,
+                                  int fd) {
+  stest_fuzz_message_t message;
+  size_t i;
+  for(i = first; i < count; i += stest_fuzz_jobs) {
+    message.type = STEST_FUZZ_STARTED;
+    message.input = (long)i;
+    stest_pipe_transfer(fd, &message, sizeof(message), 1);
+    if(!stest_fuzz_run_input(paths[i])) {
+      message.type = STEST_FUZZ_FAILED;
+      stest_pipe_transfer(fd, &message, sizeof(message), 1);
+      stest_pipe_transfer(fd, &stest_last_failure, sizeof(stest_last_failure),
+                          1);
+    }
+  }
+  message.type = STEST_FUZZ_FINISHED;
+  stest_pipe_transfer(fd, &message, sizeof(message), 1);
+  stest_impact_child_exit();
+  fflush(stdout);
+  _exit(0);
+}
+
+static int stest_fuzz_spawn(stest_fuzz_worker_t *worker, char **paths,
+                            size_t count) {
+  int fds[2];
+  worker->fd = -1;
+  worker->finished = 0;
+  worker->current = -1;
+  if(worker->next >= count)
+    return 0;
+
+  fflush(stdout);
+  if(pipe(fds) != 0 || (worker->pid = fork()) < 0) {
+    perror(stest_fuzz_current_test);
+    stest_fuzz_run_inputs(paths, count, worker->next, stest_fuzz_jobs);
+    return 0;
+  }
+  if(worker->pid == 0) {
+    close(fds[0]);
+    stest_fuzz_worker_run(paths, count, worker->next, fds[1]);
+  }
+  close(fds[1]);
+  worker->fd = fds[0];
+  return 1;
+}
+
+static int stest_fuzz_receive(stest_fuzz_worker_t *worker, char **paths) {
+  stest_fuzz_message_t message;
+  if(!stest_pipe_transfer(worker->fd, &message, sizeof(message), 0))
+    return 0;
+  if(message.type == STEST_FUZZ_FINISHED) {
+    worker->finished = 1;
+    worker->current = -1;
+  }
+  else if(message.type == STEST_FUZZ_STARTED) {
+    worker->current = message.input;
+  }
+  else {
+    worker->current = -1;
+    if(!stest_pipe_transfer(worker->fd, &stest_last_failure,
+                            sizeof(stest_last_failure), 0))
+      return 0;
+    stest_fuzz_report(paths[message.input], &stest_last_failure);
+  }
+  return 1;
+}
+
+/* Reports the input a worker died on and restarts it after that input,
+ * returns 1 when the worker is running again */
+static int stest_fuzz_reap(stest_fuzz_worker_t *worker, char **paths,
+                           size_t count) {
+  char s[STEST_PRINT_BUFFER_SIZE];
+  int status = 0;
+  close(worker->fd);
+  worker->fd = -1;
+  while(waitpid(worker->pid, &status, 0) < 0 && errno == EINTR)
+    ;
+  if(worker->finished)
+    return 0;
+  if(worker->current < 0) {
+    stest_report_test_failure(stest_fuzz_current_test,
+                              "Fuzz worker exited before it completed");
+    return 0;
+  }
+
+  if(WIFSIGNALED(status))
+    snprintf(s, sizeof(s), "Input %s crashed with signal %d (%s)",
+             paths[worker->current], WTERMSIG(status),
+             strsignal(WTERMSIG(status)));
+  else
+    snprintf(s, sizeof(s), "Input %s exited with status %d",
+             paths[worker->current], WEXITSTATUS(status));
+  stest_report_test_failure(stest_fuzz_current_test, s);
+  worker->next = worker->current + stest_fuzz_jobs;
+  return stest_fuzz_spawn(worker, paths, count);
+}
+
+/* Worker i replays inputs i, i + jobs, ... so no work queue is needed */
+static void stest_fuzz_replay_parallel(char **paths, size_t count) {
+  stest_fuzz_worker_t *workers = calloc(stest_fuzz_jobs, sizeof(*workers));
+  struct pollfd *fds = calloc(stest_fuzz_jobs, sizeof(*fds));
+  unsigned int i, active = 0;
+
+  if(workers == NULL || fds == NULL) {
+    free(workers);
+    free(fds);
+    stest_fuzz_run_inputs(paths, count, 0, 1);
+    return;
+  }
+  for(i = 0; i < stest_fuzz_jobs; i++) {
+    workers[i].next = i;
+    active += stest_fuzz_spawn(&workers[i], paths, count);
+  }
+
+  while(active > 0) {
+    for(i = 0; i < stest_fuzz_jobs; i++) {
+      fds[i].fd = workers[i].fd;
+      fds[i].events = POLLIN;
+      fds[i].revents = 0;
+    }
+    if(poll(fds, stest_fuzz_jobs, -1) < 0) {
+      if(errno == EINTR)
+        continue;
+      perror(stest_fuzz_current_test);
+      break;
+    }
+    for(i = 0; i < stest_fuzz_jobs; i++) {
+      if(fds[i].fd < 0 || fds[i].revents == 0)
+        continue;
+      if(!stest_fuzz_receive(&workers[i], paths) &&
+         !stest_fuzz_reap(&workers[i], paths, count))
+        active--;
+    }
+  }
+  free(workers);
+  free(fds);
+}
+
+static void stest_fuzz_replay(void) {
+  char **paths;
+  size_t count, i;
+  if(!stest_fuzz_list(stest_fuzz_current_directory, &paths, &count)) {
+    char s[STEST_PRINT_BUFFER_SIZE];
+    snprintf(s, sizeof(s), "Could not open corpus %s: %s",
+             stest_fuzz_current_directory, strerror(errno));
+    stest_report_test_failure(stest_fuzz_current_test, s);
+    return;
+  }
+  if(stest_fuzz_jobs > 0)
+    stest_fuzz_replay_parallel(paths, count);
+  else
+    stest_fuzz_run_inputs(paths, count, 0, 1);
+  for(i = 0; i < count; i++)
+    free(paths[i]);
+  free(paths);
+}
+
+void stest_fuzz_corpus(const char *test, stest_fuzz_target target,
+                       const char *directory) {
+  stest_fuzz_current_test = test;
+  stest_fuzz_current_target = target;
+  stest_fuzz_current_directory = directory;
+  stest_test(test, stest_fuzz_replay);
+}
+#endif
+
+static void stest_reset_counters(void) {
+  stests_run = 0;
+  stests_passed = 0;
+  stests_failed = 0;
+}
+
+int run_tests(stest_void_void tests) {
+  char s[40];
+  stest_reset_counters();
+  stest_impact_start();
+  stest_stream_open();
+  tests();
+  stest_async_run_pending();
+  stest_arena_release();
+  stest_stream_close();
+  stest_impact_stop();
+
+  if(stest_is_display_only() || stest_machine_readable)
+    return STEST_RET_OK;
+  if(stests_failed > 0) {
+    if(stest_machine_readable) {
+      stest_header_printer("Failed", sizeof("Failed") - 1, stest_screen_width,
+                           ' ');
+    }
+    else {
+      char failed[30];
+      stest_add_color(failed, "failed", STEST_RED);
+      stest_header_printer(failed, sizeof("Failed") - 1, stest_screen_width,
+                           ' ');
+    }
+  }
+  else {
+    if(stest_machine_readable) {
+      stest_header_printer("ALL TESTS PASSED", sizeof("ALL TESTS PASSED") - 1,
+                           stest_screen_width, ' ');
+    }
+    else {
+      char passed[30];
+      stest_add_color(passed, "ALL TESTS PASSED", STEST_GREEN);
+      stest_header_printer(passed, sizeof("ALL TESTS PASSED") - 1,
+                           stest_screen_width, ' ');
+    }
+  }
+  if(stests_run == 1) {
+    strcpy(s, "1 test run");
+  }
+  else {
+    sprintf(s, "%d tests run", stests_run);
+  }
+  stest_header_printer(s, strlen(s), stest_screen_width, ' ');
+  printf("\r\n");
+  stest_header_printer("", sizeof("") - 1, stest_screen_width, '=');
+
+  return STEST_RET_FAILED_COUNT(stests_failed);
+}
+
+void stest_show_help(void) {
+  printf("Usage: [-t <testname>] [-f <fixturename>] [-g <tags>] [-d] "
+         "[-h | --help] [-v]\r\n");
+  printf("       [-m] [-k <marker>] [-b <file>] [-r] [-i]\r\n");
+  printf("       [--limit-memory <bytes>] [--limit-cpu <seconds>] "
+         "[--record-impact <map>]\r\n");
+  printf("       [--impact-map <map> --changed-files <file>] "
+         "[--fuzz-jobs <n>]\r\n");
+  printf("Flags:\r\n");
+  printf("\thelp:\twill display this help\r\n");
+  printf("\t-t:\twill only run tests that match <testname>\r\n");
+  printf("\t-f:\twill only run fixtures that match <fixturename>\r\n");
+  printf("\t   \tboth can be repeated and take comma separated prefixes or\r\n");
+  printf("\t   \tglobs with * and ?, a leading ! excludes the matches\r\n");
+  printf("\t-g:\twill only run tests whose tags match <tags>, an\r\n");
+  printf("\t   \texpression of tags with !, &, | and parentheses\r\n");
+  printf("\t-d:\twill just display test names and fixtures without\r\n");
+  printf("\t\trunning the test\r\n");
+  printf("\t-v:\twill print a more verbose version of the test run\r\n");
+  printf("\t-m:\twill print a machine readable format of the test run, ie :- "
+         "\r\n");
+  printf("\t   \t<textfixture>,<testname>,<linenumber>,<testresult><EOL>\r\n");
+  printf("\t-k:\twill prepend <marker> before machine readable output \r\n");
+  printf("\t   \t<marker> cannot start with a '-'\r\n");
+  printf("\t-c:\twill color output with ANSI escape codes\r\n");
+  printf("\t-b:\twill append a binary record of each test result to <file>\r\n");
+  printf("\t-r:\twill report peak RSS, page faults, context switches and\r\n");
+  printf("\t\tCPU time of each test\r\n");
+  printf("\t-i:\twill run each test isolated in its own process\r\n");
+  printf("\t--limit-memory:\twill fail isolated tests using more than\r\n");
+  printf("\t\t<bytes> of address space, K, M and G suffixes are allowed\r\n");
+  printf("\t--limit-cpu:\twill fail isolated tests using more than\r\n");
+  printf("\t\t<seconds> of CPU time\r\n");
+  printf("\t--record-impact:\twill record the sources each test executes\r\n");
+  printf("\t\tinto <map>, needs a STEST_IMPACT build with --coverage\r\n");
+  printf("\t--impact-map:\twill read the map recorded with --record-impact\r\n");
+  printf("\t--changed-files:\twill only run tests from <map> that\r\n");
+  printf("\t\texecuted a file listed in <file>, one path per line\r\n");
+  printf("\t--fuzz-jobs:\twill replay fuzz corpora in <n> worker processes\r\n");
+  printf("\t\tand report inputs that crash a worker\r\n");
+}
+
+int stest_commandline_has_value_after(stest_testrunner_t *runner, int arg) {
+  if(!((arg + 1) < runner->argc))
+    return 0;
+  if(runner->argv[arg + 1][0] == '-')
+    return 0;
+  return 1;
+}
+
+int stest_parse_commandline_option_with_value(stest_testrunner_t *runner,
+                                              int arg, const char *option,
+                                              stest_void_string setter) {
+  if(!strcmp(runner->argv[arg], option)) {
+    if(!stest_commandline_has_value_after(runner, arg)) {
+      printf("Error: The %s option expects to be followed by a value\r\n",
+             option);
+      runner->action = STEST_DO_ABORT;
+      return 0;
+    }
+    setter(runner->argv[arg + 1]);
+    return 1;
+  }
+  return 0;
+}
+
+void stest_interpret_commandline(stest_testrunner_t *runner) {
+  int arg;
+  for(arg = 1; (arg < runner->argc) && (runner->action != STEST_DO_ABORT);
       arg++) {
     if(!strncmp(runner->argv[arg], "--help", sizeof("--help")) ||
        !strncmp(runner->argv[arg], "-h", sizeof("-h"))) {
@@ -494,15 +2680,43 @@ void stest_interpret_commandline(stest_testrunner_t *runner) {
       stest_machine_readable = 1;
     else if(!strncmp(runner->argv[arg], "-c", sizeof("-c")))
       stest_color_output = 1;
+    else if(!strncmp(runner->argv[arg], "-r", sizeof("-r")))
+      stest_report_resources = 1;
+    else if(!strncmp(runner->argv[arg], "-i", sizeof("-i")))
+      stest_isolate = 1;
     else if(stest_parse_commandline_option_with_value(runner, arg, "-t",
                                                       test_filter))
       arg++;
     else if(stest_parse_commandline_option_with_value(runner, arg, "-f",
                                                       fixture_filter))
       arg++;
+    else if(stest_parse_commandline_option_with_value(runner, arg, "-g",
+                                                      tag_filter))
+      arg++;
     else if(stest_parse_commandline_option_with_value(runner, arg, "-k",
                                                       set_magic_marker))
       arg++;
+    else if(stest_parse_commandline_option_with_value(runner, arg, "-b",
+                                                      result_stream))
+      arg++;
+    else if(stest_parse_commandline_option_with_value(
+                runner, arg, "--limit-memory", limit_memory))
+      arg++;
+    else if(stest_parse_commandline_option_with_value(
+                runner, arg, "--limit-cpu", limit_cpu))
+      arg++;
+    else if(stest_parse_commandline_option_with_value(
+                runner, arg, "--record-impact", impact_record))
+      arg++;
+    else if(stest_parse_commandline_option_with_value(
+                runner, arg, "--impact-map", impact_map))
+      arg++;
+    else if(stest_parse_commandline_option_with_value(
+                runner, arg, "--changed-files", impact_changed_files))
+      arg++;
+    else if(stest_parse_commandline_option_with_value(
+                runner, arg, "--fuzz-jobs", fuzz_jobs))
+      arg++;
     else {
       printf("Error: %s option is not supported. Here is the help menu:\n",
              runner->argv[arg]);
@@ -511,6 +2725,25 @@ void stest_interpret_commandline(stest_testrunner_t *runner) {
       return;
     }
   }
+  if(stest_option_error)
+    runner->action = STEST_DO_ABORT;
+#ifndef STEST_POSIX
+  if(stest_isolate) {
+    printf("Error: isolated tests need a POSIX system\r\n");
+    runner->action = STEST_DO_ABORT;
+  }
+  if(stest_fuzz_jobs) {
+    printf("Error: fuzz corpus replay needs a POSIX system\r\n");
+    runner->action = STEST_DO_ABORT;
+  }
+#endif
+#ifndef STEST_IMPACT
+  if(stest_impact_record_path) {
+    printf("Error: --record-impact needs a build with STEST_IMPACT defined and "
+           "--coverage enabled\r\n");
+    runner->action = STEST_DO_ABORT;
+  }
+#endif
 }
 
 void stest_testrunner_create(stest_testrunner_t *runner, int argc,
@@ -570,4 +2803,202 @@ void stest_disable_logging() {
 void stest_enable_logging() {
   stest_simple_test_result = stest_simple_test_result_log;
 }
+
+static void stest_simple_test_result_nolog_jump(int passed,
+                                                const char *reason,
+                                                const char *function,
+                                                unsigned int line) {
+  (void)reason;
+  (void)function;
+  (void)line;
+  stest_last_passed = passed;
+  if(!passed)
+    longjmp(env, 1);
+}
+
+/* Runs test_function like a test, arena reset included, and ends it at its
+ * first failed assert without logging or counting the failure */
+void stest_test_quietly(void (*test_function)(void)) {
+  void (*result)(int, const char *, const char *, unsigned int) =
+      stest_simple_test_result;
+  jmp_buf saved;
+  memcpy(saved, env, sizeof(jmp_buf));
+  stest_simple_test_result = stest_simple_test_result_nolog_jump;
+  stest_test_in_process(test_function);
+  stest_simple_test_result = result;
+  memcpy(env, saved, sizeof(jmp_buf));
+}
+
+/* Appends a record for test to the stream at path, a NULL reason is a pass */
+void stest_stream_write_result(const char *path, const char *test,
+                               const char *reason) {
+  const char *saved_path = stest_stream_path;
+  FILE *saved_file = stest_stream_file;
+  stest_failure_t saved_failure = stest_last_failure;
+  stest_stream_path = path;
+  stest_stream_open();
+  if(reason)
+    stest_remember_failure(reason, test, __LINE__);
+  stest_stream_write(test, reason != NULL, 1000);
+  stest_stream_close();
+  stest_stream_path = saved_path;
+  stest_stream_file = saved_file;
+  stest_last_failure = saved_failure;
+}
+
+int stest_filter_selects(const char *const *filters, int count,
+                         const char *name) {
+  stest_filter_t filter;
+  size_t i;
+  int selected;
+  memset(&filter, 0, sizeof(filter));
+  for(i = 0; i < (size_t)count; i++)
+    stest_filter_add(&filter, filters[i]);
+  selected = stest_filter_matches(&filter, name);
+  for(i = 0; i < filter.count; i++)
+    free(filter.patterns[i].source);
+  free(filter.patterns);
+  return selected;
+}
+
+/* Compiles the expressions without the ones given with -g and matches them
+ * against tags, returns -1 when an expression is invalid */
+int stest_tag_selects(const char *const *expressions, int count,
+                      const char *tags) {
+  char *names[STEST_MAX_TAGS];
+  stest_tag_instr_t program[STEST_MAX_TAG_PROGRAM];
+  const char *compiled[STEST_MAX_TAG_EXPRESSIONS];
+  int tag_count = stest_tag_count;
+  int expression_count = stest_tag_expression_count;
+  size_t program_len = stest_tag_program_len;
+  int i, selected = 1;
+
+  memcpy(names, stest_tag_names, sizeof(names));
+  memcpy(program, stest_tag_program, sizeof(program));
+  memcpy(compiled, stest_tag_expressions, sizeof(compiled));
+  stest_tag_count = 0;
+  stest_tag_expression_count = 0;
+  stest_tag_program_len = 0;
+  for(i = 0; i < count && selected >= 0; i++) {
+    if(!stest_tag_compile(expressions[i]))
+      selected = -1;
+  }
+  if(selected >= 0)
+    selected = stest_tags_match(stest_tag_mask(tags));
+  for(i = 0; i < stest_tag_count; i++)
+    free(stest_tag_names[i]);
+
+  memcpy(stest_tag_names, names, sizeof(names));
+  memcpy(stest_tag_program, program, sizeof(program));
+  memcpy(stest_tag_expressions, compiled, sizeof(compiled));
+  stest_tag_count = tag_count;
+  stest_tag_expression_count = expression_count;
+  stest_tag_program_len = program_len;
+  return selected;
+}
+
+#ifdef STEST_POSIX
+static int stest_fuzz_failures;
+
+static void stest_simple_test_result_count(int passed, const char *reason,
+                                           const char *function,
+                                           unsigned int line) {
+  (void)reason;
+  (void)function;
+  (void)line;
+  if(!passed)
+    stest_fuzz_failures++;
+}
+
+/* Replays the corpus like run_fuzz_corpus and returns how many inputs were
+ * reported as failed or crashed, without logging them */
+int stest_fuzz_replay_failures(stest_fuzz_target target, const char *directory,
+                               unsigned int jobs) {
+  void (*result)(int, const char *, const char *, unsigned int) =
+      stest_simple_test_result;
+  unsigned int saved_jobs = stest_fuzz_jobs;
+  jmp_buf saved;
+  memcpy(saved, env, sizeof(jmp_buf));
+  stest_simple_test_result = stest_simple_test_result_count;
+  stest_fuzz_failures = 0;
+  stest_fuzz_jobs = jobs;
+  stest_fuzz_current_test = "stest_fuzz_replay_failures";
+  stest_fuzz_current_target = target;
+  stest_fuzz_current_directory = directory;
+  stest_fuzz_replay();
+  stest_fuzz_jobs = saved_jobs;
+  stest_simple_test_result = result;
+  memcpy(env, saved, sizeof(jmp_buf));
+  return stest_fuzz_failures;
+}
+#endif
+
+#ifdef STEST_POSIX
+static void stest_simple_test_result_nolog_count(int passed,
+                                                 const char *reason,
+                                                 const char *function,
+                                                 unsigned int line) {
+  (void)reason;
+  (void)function;
+  (void)line;
+  stest_last_passed = passed;
+  if(!passed) {
+    stests_failed++;
+    longjmp(env, 1);
+  }
+}
+
+void stest_async_queue_quietly(const char *test, stest_async_start start,
+                               unsigned int timeout_ms) {
+  stest_async_queue(test, start, timeout_ms);
+}
+
+/* Runs the queued async tests without logging or recording them, and tells
+ * how many ran and failed as the fixture would count them */
+void stest_async_run_quietly(int *run, int *failed) {
+  void (*result)(int, const char *, const char *, unsigned int) =
+      stest_simple_test_result;
+  int saved_run = stests_run, saved_failed = stests_failed;
+  FILE *stream = stest_stream_file;
+  jmp_buf saved;
+  memcpy(saved, env, sizeof(jmp_buf));
+  stest_simple_test_result = stest_simple_test_result_nolog_count;
+  stest_stream_file = NULL;
+  stest_async_run_pending();
+  *run = stests_run - saved_run;
+  *failed = stests_failed - saved_failed;
+  stests_run = saved_run;
+  stests_failed = saved_failed;
+  stest_stream_file = stream;
+  stest_simple_test_result = result;
+  memcpy(env, saved, sizeof(jmp_buf));
+}
+#endif
+
+int stest_set_isolated(int isolated) {
+  int previous = stest_isolate;
+  stest_isolate = isolated;
+  return previous;
+}
+
+/* Selects with the given map and changed files, and tells whether the test
+ * of the current fixture would run */
+int stest_impact_selects(const char *map, const char *changed,
+                         const char *test) {
+  const char *saved_map = stest_impact_map_path;
+  const char *saved_changed = stest_changed_files_path;
+  stest_test_set_t saved_skipped = stest_impact_skipped;
+  int run;
+  memset(&stest_impact_skipped, 0, sizeof(stest_impact_skipped));
+  stest_impact_map_path = map;
+  stest_changed_files_path = changed;
+  stest_impact_select();
+  run = !stest_test_set_contains(&stest_impact_skipped, stest_current_fixture,
+                                 test);
+  stest_test_set_clear(&stest_impact_skipped);
+  stest_impact_skipped = saved_skipped;
+  stest_impact_map_path = saved_map;
+  stest_changed_files_path = saved_changed;
+  return run;
+}
 #endif
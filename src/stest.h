@@ -13,6 +13,40 @@ Defines
 */
 
 #define STEST_PRINT_BUFFER_SIZE 10000
+#define STEST_PLUGIN_SYMBOL "stest_plugin"
+/*
+ * Result stream written with -b: an 8 byte header holding STEST_STREAM_MAGIC
+ * and the version as a little endian u32, then one record per test. Records
+ * are little endian: u32 length of the rest of the record, u8 status, 3
+ * reserved bytes, u64 duration in nanoseconds, u32 failure line, u16 lengths
+ * of the fixture, test, file, function and failure reason, then those
+ * strings without terminators.
+ */
+#define STEST_STREAM_MAGIC "STRS"
+#define STEST_STREAM_VERSION 1
+#define STEST_STREAM_HEADER_SIZE 8
+#define STEST_STREAM_RECORD_SIZE 30
+#define STEST_STREAM_PASSED 0
+#define STEST_STREAM_FAILED 1
+#define STEST_ARENA_CHUNK_SIZE (64 * 1024)
+#define STEST_ARENA_ALIGNMENT 16
+#define STEST_ASYNC_READ 1
+#define STEST_ASYNC_WRITE 2
+#define STEST_ASYNC_DEFAULT_TIMEOUT_MS 5000
+
+#if defined(__unix__) || defined(__APPLE__)
+#define STEST_POSIX
+#endif
+/* Fuzz builds (-fsanitize=fuzzer) also define STEST_FUZZING so that
+ * STEST_FUZZ_TARGET exports the libFuzzer entry point */
+#if defined(FUZZING_BUILD_MODE_UNSAFE_FOR_PRODUCTION) && !defined(STEST_FUZZING)
+#define STEST_FUZZING
+#endif
+#ifdef __cplusplus
+#define STEST_EXTERN_C extern "C"
+#else
+#define STEST_EXTERN_C
+#endif
 
 /*
 Typedefs
@@ -21,6 +55,18 @@ Typedefs
 typedef void (*stest_void_void)(void);
 typedef void (*stest_void_string)(const char *);
 
+/* Entry point exported by fixtures built as shared objects, see STEST_PLUGIN */
+typedef struct {
+  stest_void_void tests;
+  stest_void_void setup;
+  stest_void_void teardown;
+} stest_plugin_t;
+
+typedef struct stest_async stest_async_t;
+typedef void (*stest_async_start)(stest_async_t *async);
+typedef void (*stest_async_callback)(stest_async_t *async, int fd, void *data);
+typedef void (*stest_fuzz_target)(const unsigned char *data, size_t size);
+
 /*
 Declarations
 */
@@ -52,6 +98,12 @@ void stest_assert_string_contains(const char *expected, const char *actual,
                                   const char *function, unsigned int line);
 void stest_assert_string_not_contains(const char *expected, const char *actual,
                                       const char *function, unsigned int line);
+#ifdef STEST_POSIX
+void stest_assert_peak_rss_below(unsigned long bytes, const char *function,
+                                 unsigned int line);
+void stest_assert_cpu_time_below(unsigned long ms, const char *function,
+                                 unsigned int line);
+#endif
 int stest_should_run_fixture(const char *fixture);
 int stest_should_run_test(const char *test);
 void stest_before_run(const char *fixture, const char *test);
@@ -60,6 +112,30 @@ void stest_teardown(void);
 void stest_suite_teardown(void);
 void stest_suite_setup(void);
 void stest_test(const char *test, void (*test_function)(void));
+void stest_tagged_test(const char *test, void (*test_function)(void),
+                       const char *tags);
+void stest_tagged_test_fixture_start(const char *filepath, const char *tags);
+void *stest_alloc(size_t size);
+void *stest_calloc(size_t count, size_t size);
+char *stest_strdup(const char *s);
+#ifdef STEST_POSIX
+void stest_async_test(const char *test, stest_async_start start,
+                      unsigned int timeout_ms);
+void stest_async_watch(stest_async_t *async, int fd, int events,
+                       stest_async_callback callback, void *data);
+void stest_async_unwatch(stest_async_t *async, int fd);
+void stest_async_timer(stest_async_t *async, unsigned int ms,
+                       stest_async_callback callback, void *data);
+void stest_async_done(stest_async_t *async);
+void stest_tagged_async_test(const char *test, stest_async_start start,
+                             unsigned int timeout_ms, const char *tags);
+void stest_fuzz_corpus(const char *test, stest_fuzz_target target,
+                       const char *directory);
+void stest_tagged_fuzz_corpus(const char *test, stest_fuzz_target target,
+                              const char *directory, const char *tags);
+#endif
+int stest_fuzz_one(stest_fuzz_target target, const unsigned char *data,
+                   size_t size);
 
 /*
 Assert Macros
@@ -82,6 +158,8 @@ Assert Macros
 #define assert_string_not_contains(expected, actual) do {  stest_assert_string_not_contains(expected, actual, __func__, __LINE__); } while (0)
 #define assert_string_starts_with(expected, actual) do {  stest_assert_string_starts_with(expected, actual, __func__, __LINE__); } while (0)
 #define assert_string_ends_with(expected, actual) do {  stest_assert_string_ends_with(expected, actual, __func__, __LINE__); } while (0)
+#define assert_peak_rss_below(bytes) do {  stest_assert_peak_rss_below(bytes, __func__, __LINE__); } while (0)
+#define assert_cpu_time_below(ms) do {  stest_assert_cpu_time_below(ms, __func__, __LINE__); } while (0)
 
 /*
 Fixture / Test Management
@@ -90,14 +168,36 @@ Fixture / Test Management
 void fixture_setup(void (*setup)( void ));
 void fixture_teardown(void (*teardown)( void ));
 #define run_test(test) do { stest_test(#test, test);} while (0)
+#define run_async_test(test) do { stest_async_test(#test, test, STEST_ASYNC_DEFAULT_TIMEOUT_MS);} while (0)
+#define run_async_test_timeout(test, timeout_ms) do { stest_async_test(#test, test, timeout_ms);} while (0)
+#define run_tagged_test(test, tags) do { stest_tagged_test(#test, test, tags);} while (0)
+#define run_tagged_async_test(test, tags) do { stest_tagged_async_test(#test, test, STEST_ASYNC_DEFAULT_TIMEOUT_MS, tags);} while (0)
+#define run_tagged_fuzz_corpus(target, directory, tags) do { stest_tagged_fuzz_corpus(#target, target, directory, tags);} while (0)
 #define test_fixture_start() do { stest_test_fixture_start(__FILE__); } while (0)
+#define run_fuzz_corpus(target, directory) do { stest_fuzz_corpus(#target, target, directory);} while (0)
+#define tagged_test_fixture_start(tags) do { stest_tagged_test_fixture_start(__FILE__, tags); } while (0)
 #define test_fixture_end() do { stest_test_fixture_end();} while (0)
 void fixture_filter(const char* filter);
 void test_filter(const char* filter);
+void tag_filter(const char* expression);
+void result_stream(const char* path);
+void limit_memory(const char* bytes);
+void limit_cpu(const char* seconds);
+void impact_record(const char* path);
+void impact_map(const char* path);
+void impact_changed_files(const char* path);
+void arena_chunk_size(size_t size);
+void fuzz_jobs(const char* jobs);
 void suite_teardown(stest_void_void teardown);
 void suite_setup(stest_void_void setup);
 int run_tests(stest_void_void tests);
 int stest_testrunner(int argc, char** argv, stest_void_void tests, stest_void_void setup, stest_void_void teardown);
+#define STEST_PLUGIN(tests, setup, teardown) const stest_plugin_t stest_plugin = {tests, setup, teardown}
+#ifdef STEST_FUZZING
+#define STEST_FUZZ_TARGET(name) static void name(const unsigned char *data, size_t size); STEST_EXTERN_C int LLVMFuzzerTestOneInput(const unsigned char *data, size_t size) { return stest_fuzz_one(name, data, size); } static void name(const unsigned char *data, size_t size)
+#else
+#define STEST_FUZZ_TARGET(name) static void name(const unsigned char *data, size_t size)
+#endif
 #endif
 //clang-format on
 
@@ -107,4 +207,15 @@ void stest_assert_last_passed(const char* function, unsigned int line);
 void stest_assert_last_failed(const char* function, unsigned int line);
 void stest_enable_logging(void);
 void stest_disable_logging(void);
+void stest_test_quietly(void (*test_function)(void));
+void stest_stream_write_result(const char* path, const char* test, const char* reason);
+int stest_filter_selects(const char* const* filters, int count, const char* name);
+int stest_tag_selects(const char* const* expressions, int count, const char* tags);
+#ifdef STEST_POSIX
+void stest_async_queue_quietly(const char* test, stest_async_start start, unsigned int timeout_ms);
+void stest_async_run_quietly(int* run, int* failed);
+int stest_fuzz_replay_failures(stest_fuzz_target target, const char* directory, unsigned int jobs);
+#endif
+int stest_set_isolated(int isolated);
+int stest_impact_selects(const char* map, const char* changed, const char* test);
 #endif
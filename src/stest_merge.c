@@ -0,0 +1,363 @@
+/*
+ * Copyright (c) 2021 Jia Tan
+ */
+
+#include "stest.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define STEST_MERGE_RET_ERROR (-1)
+#define STEST_MERGE_RET_OK 0
+#define STEST_MERGE_RET_FAILED 1
+#define STEST_MERGE_FIELDS 5
+
+typedef struct {
+  int status;
+  unsigned long long duration_ns;
+  unsigned long line;
+  const char *fields[STEST_MERGE_FIELDS];
+  size_t lens[STEST_MERGE_FIELDS];
+} stest_record_t;
+
+enum { STEST_FIXTURE, STEST_TEST, STEST_FILE, STEST_FUNCTION, STEST_REASON };
+
+typedef struct {
+  unsigned long long tests;
+  unsigned long long failed;
+  unsigned long long duration_ns;
+} stest_summary_t;
+
+typedef struct {
+  FILE *file;
+  const char *path;
+  unsigned char *buf;
+  size_t cap;
+  size_t len;
+} stest_stream_reader_t;
+
+static unsigned int stest_get_u16(const unsigned char *buf) {
+  return buf[0] | (unsigned int)buf[1] << 8;
+}
+
+static unsigned long stest_get_u32(const unsigned char *buf) {
+  return stest_get_u16(buf) | (unsigned long)stest_get_u16(buf + 2) << 16;
+}
+
+static unsigned long long stest_get_u64(const unsigned char *buf) {
+  return stest_get_u32(buf) | (unsigned long long)stest_get_u32(buf + 4) << 32;
+}
+
+static void stest_merge_show_help(void) {
+  printf("Usage: stest_merge [-o <stream>] [-j <json>] [-x <junit>] "
+         "<stream>...\r\n");
+  printf("Flags:\r\n");
+  printf("\t-o:\twill write all records into a single stream <stream>\r\n");
+  printf("\t-j:\twill export the results as JSON to <json>\r\n");
+  printf("\t-x:\twill export the results as JUnit XML to <junit>\r\n");
+  printf("\tA summary of all streams is always printed.\r\n");
+}
+
+static int stest_reader_open(stest_stream_reader_t *reader, const char *path) {
+  unsigned char header[STEST_STREAM_HEADER_SIZE];
+  reader->path = path;
+  reader->file = fopen(path, "rb");
+  if(reader->file == NULL) {
+    perror(path);
+    return 0;
+  }
+  if(fread(header, 1, sizeof(header), reader->file) != sizeof(header) ||
+     memcmp(header, STEST_STREAM_MAGIC, 4) != 0) {
+    printf("Error: %s is not a result stream\r\n", path);
+    fclose(reader->file);
+    return 0;
+  }
+  if(stest_get_u32(header + 4) > STEST_STREAM_VERSION) {
+    printf("Error: %s has unsupported version %lu\r\n", path,
+           stest_get_u32(header + 4));
+    fclose(reader->file);
+    return 0;
+  }
+  return 1;
+}
+
+/* Returns 1 for a record, 0 at the end of the stream and -1 on errors. The
+ * record points into the reader's buffer until the next call. */
+static int stest_reader_next(stest_stream_reader_t *reader,
+                             stest_record_t *record) {
+  unsigned char size[4];
+  size_t want, offset, i;
+  size_t n = fread(size, 1, sizeof(size), reader->file);
+  if(n == 0 && ferror(reader->file)) {
+    perror(reader->path);
+    return -1;
+  }
+  if(n == 0)
+    return 0;
+  want = stest_get_u32(size);
+  if(n != sizeof(size) || want < STEST_STREAM_RECORD_SIZE - 4)
+    goto corrupt;
+  if(want + 4 > reader->cap) {
+    unsigned char *grown = realloc(reader->buf, want + 4);
+    if(grown == NULL)
+      goto corrupt;
+    reader->buf = grown;
+    reader->cap = want + 4;
+  }
+  memcpy(reader->buf, size, sizeof(size));
+  if(fread(reader->buf + 4, 1, want, reader->file) != want)
+    goto corrupt;
+  reader->len = want + 4;
+
+  record->status = reader->buf[4];
+  record->duration_ns = stest_get_u64(reader->buf + 8);
+  record->line = stest_get_u32(reader->buf + 16);
+  offset = STEST_STREAM_RECORD_SIZE;
+  for(i = 0; i < STEST_MERGE_FIELDS; i++) {
+    record->lens[i] = stest_get_u16(reader->buf + 20 + i * 2);
+    record->fields[i] = (const char *)reader->buf + offset;
+    offset += record->lens[i];
+  }
+  if(offset > reader->len)
+    goto corrupt;
+  return 1;
+
+corrupt:
+  printf("Error: %s is truncated or corrupt\r\n", reader->path);
+  return -1;
+}
+
+static void stest_reader_close(stest_stream_reader_t *reader) {
+  if(reader->file)
+    fclose(reader->file);
+  reader->file = NULL;
+}
+
+static void stest_write_xml(FILE *out, const char *s, size_t len) {
+  size_t i;
+  for(i = 0; i < len; i++) {
+    switch(s[i]) {
+    case '<':
+      fputs("&lt;", out);
+      break;
+    case '>':
+      fputs("&gt;", out);
+      break;
+    case '&':
+      fputs("&amp;", out);
+      break;
+    case '"':
+      fputs("&quot;", out);
+      break;
+    default:
+      if((unsigned char)s[i] < 0x20 && s[i] != '\t' && s[i] != '\n')
+        fputc('?', out);
+      else
+        fputc(s[i], out);
+    }
+  }
+}
+
+static void stest_write_json(FILE *out, const char *s, size_t len) {
+  size_t i;
+  fputc('"', out);
+  for(i = 0; i < len; i++) {
+    if(s[i] == '"' || s[i] == '\\')
+      fprintf(out, "\\%c", s[i]);
+    else if((unsigned char)s[i] < 0x20)
+      fprintf(out, "\\u%04x", (unsigned char)s[i]);
+    else
+      fputc(s[i], out);
+  }
+  fputc('"', out);
+}
+
+static void stest_write_json_record(FILE *out, const stest_record_t *record,
+                                    int first) {
+  static const char *names[STEST_MERGE_FIELDS] = {"fixture", "test", "file",
+                                                  "function", "reason"};
+  int i;
+  fprintf(out, "%s\n    {", first ? "" : ",");
+  for(i = 0; i < STEST_MERGE_FIELDS; i++) {
+    fprintf(out, "\"%s\": ", names[i]);
+    stest_write_json(out, record->fields[i], record->lens[i]);
+    fputs(", ", out);
+  }
+  fprintf(out, "\"status\": \"%s\", \"line\": %lu, \"duration_ns\": %llu}",
+          record->status == STEST_STREAM_PASSED ? "passed" : "failed",
+          record->line, record->duration_ns);
+}
+
+static void stest_write_junit_record(FILE *out, const stest_record_t *record) {
+  fputs("    <testcase classname=\"", out);
+  stest_write_xml(out, record->fields[STEST_FIXTURE],
+                  record->lens[STEST_FIXTURE]);
+  fputs("\" name=\"", out);
+  stest_write_xml(out, record->fields[STEST_TEST], record->lens[STEST_TEST]);
+  fprintf(out, "\" time=\"%.6f\"", record->duration_ns / 1e9);
+  if(record->status == STEST_STREAM_PASSED) {
+    fputs("/>\n", out);
+    return;
+  }
+  fputs(">\n      <failure message=\"", out);
+  stest_write_xml(out, record->fields[STEST_REASON],
+                  record->lens[STEST_REASON]);
+  fputs("\">", out);
+  stest_write_xml(out, record->fields[STEST_FILE], record->lens[STEST_FILE]);
+  fprintf(out, ":%lu ", record->line);
+  stest_write_xml(out, record->fields[STEST_FUNCTION],
+                  record->lens[STEST_FUNCTION]);
+  fputs("</failure>\n    </testcase>\n", out);
+}
+
+/* First pass: summary, merged stream and JSON, which all fit one scan */
+static int stest_merge_scan(char **streams, int count, stest_summary_t *summary,
+                            FILE *merged, FILE *json) {
+  stest_stream_reader_t reader;
+  stest_record_t record;
+  int i, ret, ok = 1;
+
+  memset(&reader, 0, sizeof(reader));
+  for(i = 0; i < count && ok; i++) {
+    if(!stest_reader_open(&reader, streams[i])) {
+      ok = 0;
+      break;
+    }
+    while((ret = stest_reader_next(&reader, &record)) > 0) {
+      summary->tests++;
+      summary->duration_ns += record.duration_ns;
+      if(record.status != STEST_STREAM_PASSED)
+        summary->failed++;
+      if(merged)
+        fwrite(reader.buf, 1, reader.len, merged);
+      if(json)
+        stest_write_json_record(json, &record, summary->tests == 1);
+    }
+    ok = ret == 0;
+    stest_reader_close(&reader);
+  }
+  free(reader.buf);
+  return ok;
+}
+
+/* Second pass: JUnit wants the totals before the test cases */
+static int stest_merge_junit(char **streams, int count,
+                             const stest_summary_t *summary, FILE *out) {
+  stest_stream_reader_t reader;
+  stest_record_t record;
+  int i, ret, ok = 1;
+
+  fprintf(out, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+  fprintf(out,
+          "<testsuites tests=\"%llu\" failures=\"%llu\" time=\"%.6f\">\n"
+          "  <testsuite name=\"stest\" tests=\"%llu\" failures=\"%llu\" "
+          "errors=\"0\" time=\"%.6f\">\n",
+          summary->tests, summary->failed, summary->duration_ns / 1e9,
+          summary->tests, summary->failed, summary->duration_ns / 1e9);
+  memset(&reader, 0, sizeof(reader));
+  for(i = 0; i < count && ok; i++) {
+    if(!stest_reader_open(&reader, streams[i])) {
+      ok = 0;
+      break;
+    }
+    while((ret = stest_reader_next(&reader, &record)) > 0)
+      stest_write_junit_record(out, &record);
+    ok = ret == 0;
+    stest_reader_close(&reader);
+  }
+  free(reader.buf);
+  fprintf(out, "  </testsuite>\n</testsuites>\n");
+  return ok;
+}
+
+static FILE *stest_merge_create(const char *path) {
+  FILE *file;
+  if(path == NULL)
+    return NULL;
+  file = fopen(path, "wb");
+  if(file == NULL)
+    perror(path);
+  return file;
+}
+
+int main(int argc, char **argv) {
+  const char *merged_path = NULL, *json_path = NULL, *junit_path = NULL;
+  FILE *merged = NULL, *json = NULL, *junit = NULL;
+  stest_summary_t summary;
+  char **streams;
+  int count = 0, arg, ok;
+
+  streams = calloc(argc, sizeof(char *));
+  if(streams == NULL)
+    return STEST_MERGE_RET_ERROR;
+  for(arg = 1; arg < argc; arg++) {
+    const char **value = NULL;
+    if(!strcmp(argv[arg], "-o"))
+      value = &merged_path;
+    else if(!strcmp(argv[arg], "-j"))
+      value = &json_path;
+    else if(!strcmp(argv[arg], "-x"))
+      value = &junit_path;
+    else if(!strcmp(argv[arg], "-h") || !strcmp(argv[arg], "--help")) {
+      stest_merge_show_help();
+      return STEST_MERGE_RET_OK;
+    }
+    else if(argv[arg][0] == '-') {
+      printf("Error: %s option is not supported. Here is the help menu:\n",
+             argv[arg]);
+      stest_merge_show_help();
+      return STEST_MERGE_RET_ERROR;
+    }
+    else {
+      streams[count++] = argv[arg];
+      continue;
+    }
+    if(arg + 1 >= argc) {
+      printf("Error: The %s option expects to be followed by a value\r\n",
+             argv[arg]);
+      return STEST_MERGE_RET_ERROR;
+    }
+    *value = argv[++arg];
+  }
+  if(count == 0) {
+    printf("Error: no result streams were given\r\n");
+    stest_merge_show_help();
+    return STEST_MERGE_RET_ERROR;
+  }
+
+  if((merged_path && (merged = stest_merge_create(merged_path)) == NULL) ||
+     (json_path && (json = stest_merge_create(json_path)) == NULL) ||
+     (junit_path && (junit = stest_merge_create(junit_path)) == NULL))
+    return STEST_MERGE_RET_ERROR;
+
+  if(merged) {
+    unsigned char header[STEST_STREAM_HEADER_SIZE] = {0};
+    memcpy(header, STEST_STREAM_MAGIC, 4);
+    header[4] = STEST_STREAM_VERSION;
+    fwrite(header, 1, sizeof(header), merged);
+  }
+  if(json)
+    fprintf(json, "{\n  \"results\": [");
+
+  memset(&summary, 0, sizeof(summary));
+  ok = stest_merge_scan(streams, count, &summary, merged, json);
+  if(ok && junit)
+    ok = stest_merge_junit(streams, count, &summary, junit);
+
+  if(json) {
+    fprintf(json,
+            "\n  ],\n  \"summary\": {\"tests\": %llu, \"failed\": %llu, "
+            "\"duration_ns\": %llu}\n}\n",
+            summary.tests, summary.failed, summary.duration_ns);
+    fclose(json);
+  }
+  if(merged)
+    fclose(merged);
+  if(junit)
+    fclose(junit);
+
+  printf("%llu tests run, %llu failed, %.3fs\r\n", summary.tests,
+         summary.failed, summary.duration_ns / 1e9);
+  if(!ok)
+    return STEST_MERGE_RET_ERROR;
+  return summary.failed ? STEST_MERGE_RET_FAILED : STEST_MERGE_RET_OK;
+}
@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2021 Jia Tan
+ */
+
+#include "stest.h"
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#else
+#include <time.h>
+#endif
+
+#define STEST_RUNNER_POLL_MS 500
+#define STEST_RUNNER_SETTLE_MS 100
+#define STEST_RUNNER_RET_ERROR (-1)
+
+typedef struct {
+  char *path;
+  const char *name;
+  void *handle;
+  const stest_plugin_t *plugin;
+  struct stat st;
+  int wd;
+  int changed;
+} stest_runner_plugin_t;
+
+static stest_runner_plugin_t *stest_runner_plugins;
+static int stest_runner_plugin_count = 0;
+static int stest_runner_changed_only = 0;
+static long stest_runner_max_reloads = 0;
+
+static void stest_runner_show_help(void) {
+  printf("Usage: stest_runner [-w [-n <reloads>]] <plugin>... "
+         "[-- <stest options>]\r\n");
+  printf("Flags:\r\n");
+  printf("\t-w:\twill keep running and rerun the fixtures of a plugin\r\n");
+  printf("\t\twhenever its shared object is rebuilt\r\n");
+  printf("\t-n:\twill stop watching after <reloads> reruns\r\n");
+  printf("\t--:\twill pass all following options to the test runner,\r\n");
+  printf("\t\tuse '-- -h' to list them\r\n");
+}
+
+static int stest_runner_load(stest_runner_plugin_t *p) {
+  p->handle = dlopen(p->path, RTLD_NOW | RTLD_LOCAL);
+  if(p->handle == NULL) {
+    printf("Error: %s\r\n", dlerror());
+    return 0;
+  }
+  p->plugin = (const stest_plugin_t *)dlsym(p->handle, STEST_PLUGIN_SYMBOL);
+  if(p->plugin == NULL || p->plugin->tests == NULL) {
+    printf("Error: %s does not declare STEST_PLUGIN\r\n", p->path);
+    dlclose(p->handle);
+    p->handle = NULL;
+    p->plugin = NULL;
+    return 0;
+  }
+  return 1;
+}
+
+static void stest_runner_unload(stest_runner_plugin_t *p) {
+  if(p->handle != NULL)
+    dlclose(p->handle);
+  p->handle = NULL;
+  p->plugin = NULL;
+}
+
+static void stest_runner_run_plugins(void) {
+  int i;
+  for(i = 0; i < stest_runner_plugin_count; i++) {
+    stest_runner_plugin_t *p = &stest_runner_plugins[i];
+    if(p->plugin == NULL)
+      continue;
+    if(stest_runner_changed_only && !p->changed)
+      continue;
+    suite_setup(p->plugin->setup);
+    suite_teardown(p->plugin->teardown);
+    p->plugin->tests();
+  }
+}
+
+#ifdef __linux__
+static int stest_runner_watch_init(void) {
+  int fd = inotify_init1(IN_CLOEXEC);
+  int i;
+  if(fd < 0) {
+    perror("inotify_init1");
+    return -1;
+  }
+  for(i = 0; i < stest_runner_plugin_count; i++) {
+    stest_runner_plugin_t *p = &stest_runner_plugins[i];
+    char dir[STEST_PRINT_BUFFER_SIZE];
+    size_t dir_len = p->name - p->path;
+    memcpy(dir, p->path, dir_len);
+    dir[dir_len] = '\0';
+    p->wd = inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+    if(p->wd < 0) {
+      perror(dir);
+      close(fd);
+      return -1;
+    }
+  }
+  return fd;
+}
+
+static int stest_runner_watch_read(int fd, int timeout_ms) {
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  struct pollfd pfd;
+  const struct inotify_event *ev;
+  ssize_t len;
+  char *ptr;
+  int i, changed = 0;
+
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  if(poll(&pfd, 1, timeout_ms) <= 0)
+    return 0;
+  len = read(fd, buf, sizeof(buf));
+  for(ptr = buf; len > 0 && ptr < buf + len;
+      ptr += sizeof(struct inotify_event) + ev->len) {
+    ev = (const struct inotify_event *)ptr;
+    if(ev->len == 0)
+      continue;
+    for(i = 0; i < stest_runner_plugin_count; i++) {
+      stest_runner_plugin_t *p = &stest_runner_plugins[i];
+      if(p->wd == ev->wd && !strcmp(p->name, ev->name)) {
+        p->changed = 1;
+        changed = 1;
+      }
+    }
+  }
+  return changed;
+}
+
+static void stest_runner_wait_for_change(int fd) {
+  while(!stest_runner_watch_read(fd, -1))
+    ;
+  /* linkers write in several steps, let the rest of the events arrive */
+  while(stest_runner_watch_read(fd, STEST_RUNNER_SETTLE_MS))
+    ;
+}
+#else
+static int stest_runner_watch_init(void) { return 0; }
+
+static void stest_runner_sleep_ms(long ms) {
+  struct timespec ts;
+  ts.tv_sec = ms / 1000;
+  ts.tv_nsec = (ms % 1000) * 1000000L;
+  nanosleep(&ts, NULL);
+}
+
+static int stest_runner_stat_changed(stest_runner_plugin_t *p) {
+  struct stat st;
+  if(stat(p->path, &st) != 0)
+    return 0;
+  if(st.st_mtime == p->st.st_mtime && st.st_size == p->st.st_size &&
+     st.st_ino == p->st.st_ino)
+    return 0;
+  p->st = st;
+  return 1;
+}
+
+static void stest_runner_wait_for_change(int fd) {
+  int i, changed = 0;
+  (void)fd;
+  while(!changed) {
+    stest_runner_sleep_ms(STEST_RUNNER_POLL_MS);
+    for(i = 0; i < stest_runner_plugin_count; i++) {
+      if(stest_runner_stat_changed(&stest_runner_plugins[i])) {
+        stest_runner_plugins[i].changed = 1;
+        changed = 1;
+      }
+    }
+  }
+  stest_runner_sleep_ms(STEST_RUNNER_SETTLE_MS);
+}
+#endif
+
+static int stest_runner_watch(int argc, char **argv) {
+  int fd = stest_runner_watch_init();
+  int i, ret = STEST_RUNNER_RET_ERROR;
+  long reloads;
+  if(fd < 0)
+    return STEST_RUNNER_RET_ERROR;
+
+  stest_runner_changed_only = 1;
+  for(reloads = 0;
+      stest_runner_max_reloads == 0 || reloads < stest_runner_max_reloads;
+      reloads++) {
+    stest_runner_wait_for_change(fd);
+    for(i = 0; i < stest_runner_plugin_count; i++) {
+      stest_runner_plugin_t *p = &stest_runner_plugins[i];
+      if(!p->changed)
+        continue;
+      printf("Reloading %s\r\n", p->name);
+      stest_runner_unload(p);
+      stest_runner_load(p);
+      stat(p->path, &p->st);
+    }
+    ret = stest_testrunner(argc, argv, stest_runner_run_plugins, NULL, NULL);
+    fflush(stdout);
+    for(i = 0; i < stest_runner_plugin_count; i++)
+      stest_runner_plugins[i].changed = 0;
+  }
+  return ret;
+}
+
+static int stest_runner_add_plugin(const char *path) {
+  stest_runner_plugin_t *p = &stest_runner_plugins[stest_runner_plugin_count];
+  const char *name;
+  p->path = realpath(path, NULL);
+  if(p->path == NULL) {
+    perror(path);
+    return 0;
+  }
+  name = strrchr(p->path, '/');
+  p->name = name ? name + 1 : p->path;
+  stat(p->path, &p->st);
+  stest_runner_plugin_count++;
+  return 1;
+}
+
+int main(int argc, char **argv) {
+  char **stest_argv;
+  int stest_argc = 1;
+  int watch = 0;
+  int arg, ret, i;
+
+  stest_runner_plugins = calloc(argc, sizeof(stest_runner_plugin_t));
+  stest_argv = calloc(argc + 1, sizeof(char *));
+  if(stest_runner_plugins == NULL || stest_argv == NULL)
+    return STEST_RUNNER_RET_ERROR;
+  stest_argv[0] = argv[0];
+
+  for(arg = 1; arg < argc; arg++) {
+    if(!strcmp(argv[arg], "--")) {
+      for(arg++; arg < argc; arg++)
+        stest_argv[stest_argc++] = argv[arg];
+    }
+    else if(!strcmp(argv[arg], "-w"))
+      watch = 1;
+    else if(!strcmp(argv[arg], "-n") && arg + 1 < argc) {
+      char *end;
+      stest_runner_max_reloads = strtol(argv[++arg], &end, 10);
+      if(*end != '\0' || stest_runner_max_reloads <= 0) {
+        printf("Error: The -n option expects a number of reloads, got %s\r\n",
+               argv[arg]);
+        return STEST_RUNNER_RET_ERROR;
+      }
+    }
+    else if(!strcmp(argv[arg], "-h") || !strcmp(argv[arg], "--help")) {
+      stest_runner_show_help();
+      return 0;
+    }
+    else if(argv[arg][0] == '-') {
+      printf("Error: %s option is not supported. Here is the help menu:\n",
+             argv[arg]);
+      stest_runner_show_help();
+      return STEST_RUNNER_RET_ERROR;
+    }
+    else if(!stest_runner_add_plugin(argv[arg]))
+      return STEST_RUNNER_RET_ERROR;
+  }
+
+  if(stest_runner_plugin_count == 0) {
+    printf("Error: no plugins were given\r\n");
+    stest_runner_show_help();
+    return STEST_RUNNER_RET_ERROR;
+  }
+
+  for(i = 0; i < stest_runner_plugin_count; i++) {
+    if(!stest_runner_load(&stest_runner_plugins[i]) && !watch)
+      return STEST_RUNNER_RET_ERROR;
+  }
+
+  ret = stest_testrunner(stest_argc, stest_argv, stest_runner_run_plugins,
+                         NULL, NULL);
+  if(!watch)
+    return ret;
+  fflush(stdout);
+  return stest_runner_watch(stest_argc, stest_argv);
+}
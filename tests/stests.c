@@ -5,6 +5,14 @@
 
 #include "stests.h"
 #include "stddef.h"
+#include <string.h>
+#ifdef STEST_POSIX
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 static void test_assert_n_array_equal(void) {
   int array_1[4] = {0, 1, 2, 3};
@@ -121,7 +129,474 @@ static void(test_assert_string_ends_with)(void) {
   assert_test_fails(assert_string_ends_with(str2, str1));
 }
 
+static void test_stest_alloc(void) {
+  char *a = stest_alloc(10);
+  char *b = stest_alloc(10);
+  char *big = stest_alloc(STEST_ARENA_CHUNK_SIZE * 2);
+  int *zeroed = stest_calloc(4, sizeof(int));
+
+  assert_true(a != NULL);
+  assert_true(b >= a + 10);
+  assert_int_equal(0, (int)((size_t)b % STEST_ARENA_ALIGNMENT));
+  assert_true(big != NULL);
+  big[STEST_ARENA_CHUNK_SIZE * 2 - 1] = 1;
+  assert_int_equal(0, zeroed[0] | zeroed[3]);
+  assert_string_equal("arena", stest_strdup("arena"));
+}
+
+static char *arena_first;
+
+static void arena_alloc(void) {
+  arena_first = stest_alloc(32);
+  assert_true(arena_first != NULL);
+}
+
+static void arena_alloc_and_fail(void) {
+  arena_alloc();
+  assert_fail("arena");
+}
+
+static void test_stest_alloc_reset(void) {
+  char *first;
+  assert_test_passes(stest_test_quietly(arena_alloc));
+  first = stest_alloc(32);
+  assert_true(first == arena_first);
+  assert_test_fails(stest_test_quietly(arena_alloc_and_fail));
+  assert_true(stest_alloc(32) == first);
+  assert_test_fails(stest_alloc((size_t)-1 - 4));
+  assert_test_fails(stest_calloc(2, (size_t)-1 / 2));
+}
+
+static void test_filter_patterns(void) {
+  static const struct {
+    const char *filter;
+    const char *name;
+    int selected;
+  } cases[] = {
+      {"test_a", "test_assert", 1},      {"assert", "test_assert", 0},
+      {"*assert", "test_assert", 1},     {"*assert", "test_assert_true", 0},
+      {"t?st_*", "test_assert", 1},      {"t?st_*", "tst_assert", 0},
+      {"*aab", "aaab", 1},               {"*a*b*c", "xaybbzc", 1},
+      {"a*?c", "abc", 1},                {"a*?c", "ac", 0},
+      {"a*b", "ab", 1},                  {"a*b", "abba", 0},
+      {"!*slow*", "test_slow_path", 0},  {"!*slow*", "test_fast", 1},
+      {"test_,!test_b*", "test_big", 0}, {"test_,!test_b*", "test_small", 1},
+      {"other,test_s", "test_small", 1}, {"other", "test_small", 0},
+  };
+  const char *repeated[] = {"test_", "!*_disabled"};
+  size_t i;
+  for(i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    assert_int_equal(cases[i].selected,
+                     stest_filter_selects(&cases[i].filter, 1, cases[i].name));
+  assert_int_equal(1, stest_filter_selects(repeated, 2, "test_parse"));
+  assert_int_equal(0, stest_filter_selects(repeated, 2, "test_parse_disabled"));
+  assert_int_equal(0, stest_filter_selects(repeated, 2, "bench_parse"));
+}
+
+static void test_tag_expressions(void) {
+  static const struct {
+    const char *expression;
+    const char *tags;
+    int selected;
+  } cases[] = {
+      {"!a & b | c", "b", 1},     {"!a & b | c", "a b", 0},
+      {"!a & b | c", "a,c", 1},   {"!a & b | c", "", 0},
+      {"!(a | b)", "c", 1},       {"!(a | b)", "b", 0},
+      {"a & (b | c)", "a c", 1},  {"a & (b | c)", "c", 0},
+      {"a & (b | c)", "a", 0},    {"a | b & c", "a", 1},
+      {"(a | b) & c", "a", 0},    {"!!a", "a", 1},
+      {"a &&", "a", -1},          {"(a", "a", -1},
+      {"a)", "a", -1},            {"", "a", -1},
+  };
+  const char *all[] = {"a | b", "!c"};
+  char many[STEST_PRINT_BUFFER_SIZE];
+  const char *expression = many;
+  size_t i, len = 0;
+  for(i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    assert_int_equal(cases[i].selected,
+                     stest_tag_selects(&cases[i].expression, 1, cases[i].tags));
+  assert_int_equal(1, stest_tag_selects(all, 2, "a"));
+  assert_int_equal(0, stest_tag_selects(all, 2, "a c"));
+  assert_int_equal(0, stest_tag_selects(all, 2, "d"));
+
+  /* a program holds at most 64 distinct tags */
+  for(i = 0; i < 64; i++)
+    len += sprintf(many + len, "%st%d", i ? "|" : "", (int)i);
+  assert_int_equal(1, stest_tag_selects(&expression, 1, "t63"));
+  sprintf(many + len, "|t64");
+  assert_int_equal(-1, stest_tag_selects(&expression, 1, "t63"));
+}
+
+#ifdef STEST_POSIX
+#define TEMP_PATH_SIZE 512
+
+/* Creates a file holding content under TMPDIR, path has TEMP_PATH_SIZE bytes */
+static void write_temp_file(char *path, const char *content) {
+  const char *tmp = getenv("TMPDIR");
+  FILE *f;
+  int fd;
+  snprintf(path, TEMP_PATH_SIZE, "%s/stests-XXXXXX", tmp ? tmp : "/tmp");
+  fd = mkstemp(path);
+  assert_true(fd >= 0);
+  f = fdopen(fd, "w");
+  fputs(content, f);
+  fclose(f);
+}
+
+static int impact_selects(const char *map, const char *changed,
+                          const char *test) {
+  char map_path[TEMP_PATH_SIZE], changed_path[TEMP_PATH_SIZE];
+  int run;
+  write_temp_file(map_path, map);
+  write_temp_file(changed_path, changed);
+  run = stest_impact_selects(map_path, changed_path, test);
+  unlink(map_path);
+  unlink(changed_path);
+  return run;
+}
+
+static void test_impact_select(void) {
+  const char *map = "stests.c\tparse\tCMakeFiles/t.dir/src/parser.c\n"
+                    "stests.c\tlex\tsrc/lexer\n"
+                    "stests.c\tlinked\tt-parser\n"
+                    "stests.c\tdashed\tt-my-parser\n"
+                    "stests.c\tuncovered\n";
+  const char *lexer = "src/lexer.c\n";
+
+  assert_true(impact_selects(map, "src/parser.c\n", "parse"));
+  assert_false(impact_selects(map, "src/parser.c\n", "lex"));
+  assert_true(impact_selects(map, "src/parser.c\n", "linked"));
+  assert_false(impact_selects(map, lexer, "linked"));
+  assert_true(impact_selects(map, lexer, "lex"));
+  assert_true(impact_selects(map, lexer, "uncovered"));
+  assert_true(impact_selects(map, lexer, "missing_from_map"));
+  assert_true(impact_selects(map, "src/my-parser.c\n", "dashed"));
+  assert_false(impact_selects(map, "src/my-parser.c\n", "linked"));
+  assert_true(impact_selects(map, "src/lexer.c\ninclude/config.h\n", "parse"));
+}
+
+#if defined(STEST_MERGE_PATH) || defined(STEST_RUNNER_PATH)
+static char *read_file(const char *path) {
+  FILE *f = fopen(path, "rb");
+  char *content = stest_calloc(1, 4096);
+  assert_true(f != NULL);
+  fread(content, 1, 4095, f);
+  fclose(f);
+  return content;
+}
+#endif
+
+#ifdef STEST_MERGE_PATH
+
+static int run_merge(const char *arguments) {
+  char command[4 * TEMP_PATH_SIZE];
+  snprintf(command, sizeof(command), "\"%s\" %s >/dev/null", STEST_MERGE_PATH,
+           arguments);
+  return WEXITSTATUS(system(command));
+}
+
+static void test_stream_merge_round_trip(void) {
+  const char *reason = "Expected \"a, b\" <c> & d";
+  char stream[TEMP_PATH_SIZE], merged[TEMP_PATH_SIZE], json[TEMP_PATH_SIZE],
+      xml[TEMP_PATH_SIZE], arguments[4 * TEMP_PATH_SIZE];
+  char *first_json;
+
+  write_temp_file(stream, "");
+  write_temp_file(merged, "");
+  write_temp_file(json, "");
+  write_temp_file(xml, "");
+  unlink(merged);
+  stest_stream_write_result(stream, "round_trip_passed", NULL);
+  stest_stream_write_result(stream, "round_trip_failed", reason);
+
+  snprintf(arguments, sizeof(arguments), "-o \"%s\" -j \"%s\" -x \"%s\" \"%s\"",
+           merged, json, xml, stream);
+  assert_int_equal(1, run_merge(arguments));
+  first_json = read_file(json);
+  assert_string_contains("\"test\": \"round_trip_passed\"", first_json);
+  assert_string_contains("\"status\": \"passed\"", first_json);
+  assert_string_contains("\"reason\": \"Expected \\\"a, b\\\" <c> & d\"",
+                         first_json);
+  assert_string_contains(
+      "message=\"Expected &quot;a, b&quot; &lt;c&gt; &amp; d\"",
+      read_file(xml));
+
+  /* the merged stream holds the same records */
+  snprintf(arguments, sizeof(arguments), "-j \"%s\" \"%s\"", json, merged);
+  assert_int_equal(1, run_merge(arguments));
+  assert_string_equal(first_json, read_file(json));
+
+  assert_int_equal(0, truncate(stream, 20));
+  snprintf(arguments, sizeof(arguments), "\"%s\"", stream);
+  assert_int_equal(255, run_merge(arguments));
+
+  unlink(stream);
+  unlink(merged);
+  unlink(json);
+  unlink(xml);
+}
+#endif
+
+#ifdef STEST_RUNNER_PATH
+static void copy_file(const char *from, const char *to) {
+  FILE *in = fopen(from, "rb"), *out = fopen(to, "wb");
+  char buf[4096];
+  size_t n;
+  assert_true(in != NULL && out != NULL);
+  while((n = fread(buf, 1, sizeof(buf), in)) > 0)
+    fwrite(buf, 1, n, out);
+  fclose(in);
+  fclose(out);
+}
+
+/* Waits up to 10 seconds for text to show up in the file */
+static int wait_for_output(const char *path, const char *text) {
+  char output[4096];
+  int i;
+  for(i = 0; i < 1000; i++) {
+    FILE *f = fopen(path, "rb");
+    size_t n = f ? fread(output, 1, sizeof(output) - 1, f) : 0;
+    if(f)
+      fclose(f);
+    output[n] = '\0';
+    if(strstr(output, text))
+      return 1;
+    usleep(10000);
+  }
+  return 0;
+}
+
+/* Swaps the first of two watched plugins for a version with one more test,
+ * only that plugin has to be reloaded and rerun */
+static void test_runner_reloads_changed_plugin(void) {
+  const char *tmp = getenv("TMPDIR");
+  char dir[TEMP_PATH_SIZE], p[TEMP_PATH_SIZE + 16], q[TEMP_PATH_SIZE + 16],
+      next[TEMP_PATH_SIZE + 16], log[TEMP_PATH_SIZE + 16];
+  const char *output, *reload;
+  int status = -1, started, i;
+  pid_t pid;
+
+  snprintf(dir, sizeof(dir), "%s/stests-runner-XXXXXX", tmp ? tmp : "/tmp");
+  assert_true(mkdtemp(dir) != NULL);
+  sprintf(p, "%s/p.so", dir);
+  sprintf(q, "%s/q.so", dir);
+  sprintf(next, "%s/next.so", dir);
+  sprintf(log, "%s/output", dir);
+  copy_file(STESTS_PLUGIN_V1_PATH, p);
+  copy_file(STESTS_PLUGIN_V1_PATH, q);
+
+  fflush(stdout);
+  pid = fork();
+  assert_true(pid >= 0);
+  if(pid == 0) {
+    int fd = open(log, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    dup2(fd, 1);
+    execl(STEST_RUNNER_PATH, STEST_RUNNER_PATH, "-w", "-n", "1", p, q,
+          (char *)NULL);
+    _exit(127);
+  }
+  started = wait_for_output(log, "2 tests run");
+  copy_file(STESTS_PLUGIN_V2_PATH, next);
+  rename(next, p);
+  for(i = 0; i < 1000 && waitpid(pid, &status, WNOHANG) == 0; i++)
+    usleep(10000);
+  if(i == 1000) {
+    kill(pid, SIGKILL);
+    waitpid(pid, &status, 0);
+  }
+  output = read_file(log);
+  unlink(p);
+  unlink(q);
+  unlink(log);
+  rmdir(dir);
+
+  assert_true(started);
+  assert_true(WIFEXITED(status));
+  assert_int_equal(0, WEXITSTATUS(status));
+  reload = strstr(output, "Reloading p.so");
+  assert_true(reload != NULL);
+  assert_string_not_contains("Reloading q.so", output);
+  assert_string_contains("2 tests run", reload);
+}
+#endif
+
+static void test_assert_peak_rss_below(void) {
+  assert_test_passes(assert_peak_rss_below(1UL << 40));
+  assert_test_fails(assert_peak_rss_below(1));
+}
+
+static void test_assert_cpu_time_below(void) {
+  assert_test_passes(assert_cpu_time_below(60000));
+  assert_test_fails(assert_cpu_time_below(0));
+}
+
+static int async_pipe[2];
+static int async_timer_count;
+
+static void async_pipe_write(stest_async_t *async, int fd, void *data) {
+  (void)async;
+  (void)fd;
+  (void)data;
+  assert_int_equal(1, (int)write(async_pipe[1], "x", 1));
+}
+
+static void async_pipe_read(stest_async_t *async, int fd, void *data) {
+  char c = 0;
+  (void)data;
+  assert_int_equal(1, (int)read(fd, &c, 1));
+  assert_int_equal('x', c);
+  stest_async_unwatch(async, fd);
+  close(async_pipe[0]);
+  close(async_pipe[1]);
+  stest_async_done(async);
+}
+
+static void test_async_fd_ready(stest_async_t *async) {
+  assert_int_equal(0, pipe(async_pipe));
+  stest_async_watch(async, async_pipe[0], STEST_ASYNC_READ, async_pipe_read,
+                    NULL);
+  stest_async_timer(async, 10, async_pipe_write, NULL);
+}
+
+static void async_count_down(stest_async_t *async, int fd, void *data) {
+  int *count = data;
+  (void)fd;
+  if(--*count == 0)
+    stest_async_done(async);
+  else
+    stest_async_timer(async, 1, async_count_down, data);
+}
+
+static void test_async_timer(stest_async_t *async) {
+  async_timer_count = 3;
+  stest_async_timer(async, 1, async_count_down, &async_timer_count);
+}
+
+static int async_setups;
+static int async_teardowns;
+
+static void async_setup(void) { async_setups++; }
+
+static void async_teardown(void) { async_teardowns++; }
+
+static void async_fail(stest_async_t *async, int fd, void *data) {
+  (void)async;
+  (void)fd;
+  (void)data;
+  assert_fail("failing async test");
+}
+
+static void async_pass(stest_async_t *async, int fd, void *data) {
+  (void)fd;
+  (void)data;
+  /* the batch is torn down once, after its last test */
+  assert_int_equal(0, async_teardowns);
+  stest_async_done(async);
+}
+
+static void async_failing(stest_async_t *async) {
+  stest_async_timer(async, 1, async_fail, NULL);
+}
+
+static void async_hanging(stest_async_t *async) { (void)async; }
+
+static void async_passing(stest_async_t *async) {
+  stest_async_timer(async, 30, async_pass, NULL);
+}
+
+static void test_async_failures_stay_in_their_test(void) {
+  int run, failed;
+  async_setups = async_teardowns = 0;
+  fixture_setup(async_setup);
+  fixture_teardown(async_teardown);
+  stest_async_queue_quietly("async_failing", async_failing, 1000);
+  stest_async_queue_quietly("async_hanging", async_hanging, 10);
+  stest_async_queue_quietly("async_passing", async_passing, 1000);
+  fixture_setup(NULL);
+  fixture_teardown(NULL);
+  stest_async_run_quietly(&run, &failed);
+  assert_int_equal(3, run);
+  assert_int_equal(2, failed);
+  assert_int_equal(1, async_setups);
+  assert_int_equal(1, async_teardowns);
+}
+
+static const char *fuzz_inputs[] = {"", "stest", "\x01\xff"};
+static const char *fuzz_verdict_inputs[] = {"ok", "bad", "", "bad input"};
+static const char *fuzz_crash_inputs[] = {"ok", "crash", "bad", "",
+                                          "bad input"};
+static char fuzz_corpus[TEMP_PATH_SIZE];
+
+STEST_FUZZ_TARGET(fuzz_stest_strdup) {
+  char *input = stest_alloc(size + 1);
+  memcpy(input, data, size);
+  input[size] = '\0';
+  assert_string_equal(input, stest_strdup(input));
+}
+
+STEST_FUZZ_TARGET(fuzz_verdict) {
+  if(size >= 5 && !memcmp(data, "crash", 5))
+    abort();
+  assert_false(size >= 3 && !memcmp(data, "bad", 3));
+}
+
+/* Writes each input to a file named after its index in a new directory
+ * under TMPDIR, a corpus that cannot be created replays as missing */
+static void create_corpus(char *dir, const char **inputs, int count) {
+  const char *tmp = getenv("TMPDIR");
+  char path[TEMP_PATH_SIZE + 16];
+  int i;
+  snprintf(dir, TEMP_PATH_SIZE, "%s/stests-corpus-XXXXXX", tmp ? tmp : "/tmp");
+  if(mkdtemp(dir) == NULL)
+    return;
+  for(i = 0; i < count; i++) {
+    FILE *f;
+    sprintf(path, "%s/%d", dir, i);
+    f = fopen(path, "wb");
+    if(f == NULL)
+      return;
+    fwrite(inputs[i], 1, strlen(inputs[i]), f);
+    fclose(f);
+  }
+}
+
+static void remove_corpus(const char *dir, int count) {
+  char path[TEMP_PATH_SIZE + 16];
+  int i;
+  for(i = 0; i < count; i++) {
+    sprintf(path, "%s/%d", dir, i);
+    unlink(path);
+  }
+  rmdir(dir);
+}
+
+static void create_fuzz_corpus(void) {
+  create_corpus(fuzz_corpus, fuzz_inputs, 3);
+}
+
+static void remove_fuzz_corpus(void) { remove_corpus(fuzz_corpus, 3); }
+
+static void test_fuzz_replay_reports_inputs(void) {
+  char dir[TEMP_PATH_SIZE];
+  create_corpus(dir, fuzz_verdict_inputs, 4);
+  assert_int_equal(2, stest_fuzz_replay_failures(fuzz_verdict, dir, 0));
+  assert_int_equal(2, stest_fuzz_replay_failures(fuzz_verdict, dir, 3));
+  remove_corpus(dir, 4);
+
+  /* the worker restarts after the crash and still reports both failures */
+  create_corpus(dir, fuzz_crash_inputs, 5);
+  assert_int_equal(3, stest_fuzz_replay_failures(fuzz_verdict, dir, 1));
+  assert_int_equal(3, stest_fuzz_replay_failures(fuzz_verdict, dir, 2));
+  remove_corpus(dir, 5);
+
+  assert_int_equal(1, stest_fuzz_replay_failures(fuzz_verdict, dir, 0));
+}
+#endif
+
 void test_fixture_stest() {
+#ifdef STEST_POSIX
+  int isolated;
+#endif
   test_fixture_start();
   run_test(test_assert_true);
   run_test(test_assert_false);
@@ -138,9 +613,40 @@ void test_fixture_stest() {
   run_test(test_assert_string_not_contains);
   run_test(test_assert_string_starts_with);
   run_test(test_assert_string_ends_with);
+  run_test(test_stest_alloc);
+  run_test(test_stest_alloc_reset);
+  run_test(test_filter_patterns);
+  run_test(test_tag_expressions);
+#ifdef STEST_POSIX
+  run_test(test_impact_select);
+#ifdef STEST_MERGE_PATH
+  run_test(test_stream_merge_round_trip);
+#endif
+#ifdef STEST_RUNNER_PATH
+  run_test(test_runner_reloads_changed_plugin);
+#endif
+  run_tagged_test(test_assert_peak_rss_below, "resources");
+  run_tagged_test(test_assert_cpu_time_below, "resources");
+  isolated = stest_set_isolated(1);
+  stest_tagged_test("test_assert_cpu_time_below_isolated",
+                    test_assert_cpu_time_below, "resources");
+  stest_set_isolated(isolated);
+  run_tagged_test(test_async_failures_stay_in_their_test, "async");
+  run_tagged_async_test(test_async_fd_ready, "async");
+  run_tagged_async_test(test_async_timer, "async");
+  /* the set-up only runs when the replay does, not with -d or filtered out */
+  fixture_setup(create_fuzz_corpus);
+  fixture_teardown(remove_fuzz_corpus);
+  run_tagged_fuzz_corpus(fuzz_stest_strdup, fuzz_corpus, "fuzz");
+  fixture_setup(NULL);
+  fixture_teardown(NULL);
+  run_tagged_test(test_fuzz_replay_reports_inputs, "fuzz");
+#endif
   test_fixture_end();
 }
 
+STEST_PLUGIN(test_fixture_stest, NULL, NULL);
+
 int main(int argc, char **argv) {
   return stest_testrunner(argc, argv, test_fixture_stest, NULL, NULL);
 }
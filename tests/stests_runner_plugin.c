@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2021 Jia Tan
+ */
+
+/* Built twice, with one and two tests, to check the runner's reload */
+#include "../src/stest.h"
+
+static void test_plugin_loaded(void) { assert_true(1); }
+
+#if STESTS_PLUGIN_VERSION > 1
+static void test_plugin_reloaded(void) { assert_true(1); }
+#endif
+
+static void test_fixture_runner_plugin(void) {
+  test_fixture_start();
+  run_test(test_plugin_loaded);
+#if STESTS_PLUGIN_VERSION > 1
+  run_test(test_plugin_reloaded);
+#endif
+  test_fixture_end();
+}
+
+STEST_PLUGIN(test_fixture_runner_plugin, NULL, NULL);